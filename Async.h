@@ -0,0 +1,120 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define E2EE_HAS_COROUTINES 1
+#endif
+
+#include "Executor.h"
+
+namespace E2EE {
+
+// Runs function on executor and returns a future for its result.
+template <typename T>
+std::future<T> runAsync(Executor& executor, std::function<T()> function)
+{
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(function));
+    std::future<T> future = task->get_future();
+    executor.execute([task] { (*task)(); });
+    return future;
+}
+
+#ifdef E2EE_HAS_COROUTINES
+
+// co_await runs function on executor and resumes the awaiting coroutine there with its result.
+// The executor is kept alive until then.
+template <typename T>
+class Awaitable
+{
+public:
+    Awaitable(std::shared_ptr<Executor> executor, std::function<T()> function)
+        : m_executor(std::move(executor))
+        , m_function(std::move(function))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // Nothing of this may be touched once the task is queued, the coroutine can resume and
+        // destroy it right away, so the executor reference is dropped on this thread instead.
+        const std::shared_ptr<Executor> executor = std::move(m_executor);
+        executor->execute([this, handle] {
+            try {
+                m_value.emplace(m_function());
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+            handle.resume();
+        });
+    }
+
+    T await_resume()
+    {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+        return std::move(*m_value);
+    }
+
+private:
+    std::shared_ptr<Executor> m_executor;
+    std::function<T()> m_function;
+    std::optional<T>   m_value;
+    std::exception_ptr m_error;
+};
+
+template <>
+class Awaitable<void>
+{
+public:
+    Awaitable(std::shared_ptr<Executor> executor, std::function<void()> function)
+        : m_executor(std::move(executor))
+        , m_function(std::move(function))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // Nothing of this may be touched once the task is queued, the coroutine can resume and
+        // destroy it right away, so the executor reference is dropped on this thread instead.
+        const std::shared_ptr<Executor> executor = std::move(m_executor);
+        executor->execute([this, handle] {
+            try {
+                m_function();
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+            handle.resume();
+        });
+    }
+
+    void await_resume()
+    {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    std::shared_ptr<Executor> m_executor;
+    std::function<void()> m_function;
+    std::exception_ptr    m_error;
+};
+
+#endif
+
+} // namespace E2EE
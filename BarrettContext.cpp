@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "BarrettContext.h"
+
+BarrettContext::BarrettContext(const BigInteger& modulus)
+    : m_modulus(modulus)
+{
+    if (modulus <= 1) {
+        throw std::invalid_argument("Barrett modulus must be greater than one.");
+    }
+    const size_t n = modulus.unit_count();
+    if (n > max_units) {
+        throw std::invalid_argument("Barrett modulus is too large.");
+    }
+    m_units.resize(n + 1);
+    modulus.to_units(m_units.data(), n + 1);
+
+    // mu = floor(2^(128 * n) / p), at most n + 1 limbs.
+    unit_t power[2 * max_units + 1];
+    std::fill(power, power + 2 * n + 1, 0);
+    power[2 * n] = 1;
+    m_mu.resize(n + 1);
+    (BigInteger::from_units(power, 2 * n + 1) / modulus).to_units(m_mu.data(), n + 1);
+
+    m_one.assign(n, 0);
+    m_one[0] = 1;
+}
+
+BarrettContext::BarrettContext(const unit_t* modulus, size_t n, const unit_t* mu)
+    : m_modulus(BigInteger::from_units(modulus, n))
+    , m_units(modulus, modulus + n)
+    , m_mu(mu, mu + n + 1)
+    , m_one(n, 0)
+{
+    if (n == 0 || n > max_units || m_units.back() == 0) {
+        throw std::invalid_argument("Barrett modulus must be at most max_units limbs long.");
+    }
+    m_units.push_back(0);
+    m_one[0] = 1;
+}
+
+const BigInteger& BarrettContext::modulus() const
+{
+    return m_modulus;
+}
+
+size_t BarrettContext::size() const
+{
+    return m_one.size();
+}
+
+void BarrettContext::add(unit_t* result, const unit_t* lhs, const unit_t* rhs) const
+{
+    limbs::add_mod_n(result, lhs, rhs, m_units.data(), size());
+}
+
+void BarrettContext::multiply(unit_t* result, const unit_t* lhs, const unit_t* rhs) const
+{
+    const size_t n = size();
+    unit_t product[2 * max_units];
+    limbs::mul_n(product, lhs, rhs, n);
+    reduce(result, product);
+}
+
+void BarrettContext::square(unit_t* result, const unit_t* value) const
+{
+    unit_t product[2 * max_units];
+    limbs::sqr(product, value, size());
+    reduce(result, product);
+}
+
+void BarrettContext::reduce(unit_t* result, const unit_t* value) const
+{
+    const size_t n = size();
+
+    // q = floor(floor(value / 2^(64 * (n - 1))) * mu / 2^(64 * (n + 1))) undershoots the
+    // quotient by at most two, so value - q * p needs at most two corrections.
+    unit_t estimate[2 * max_units + 2];
+    limbs::mul_basecase(estimate, value + n - 1, n + 1, m_mu.data(), n + 1);
+    const unit_t* quotient = estimate + n + 1;
+
+    unit_t product[2 * max_units + 2];
+    limbs::mul_basecase(product, quotient, n + 1, m_units.data(), n);
+
+    unit_t remainder[max_units + 1];
+    limbs::sub_n(remainder, value, product, n + 1);
+    while (limbs::cmp_n(remainder, m_units.data(), n + 1) >= 0) {
+        limbs::sub_n(remainder, remainder, m_units.data(), n + 1);
+    }
+    std::copy(remainder, remainder + n, result);
+}
+
+void BarrettContext::to_residue(unit_t* result, const BigInteger& value) const
+{
+    const size_t n = size();
+    if (value < 0 || value.unit_count() > 2 * n) {
+        BigInteger reduced = value % m_modulus;
+        if (reduced < 0) {
+            reduced += m_modulus;
+        }
+        reduced.to_units(result, n);
+        return;
+    }
+    unit_t units[2 * max_units];
+    value.to_units(units, 2 * n);
+    reduce(result, units);
+}
+
+BigInteger BarrettContext::from_residue(const unit_t* value) const
+{
+    return BigInteger::from_units(value, size());
+}
+
+void BarrettContext::to_residue(unit_t* result, const unit_t* value) const
+{
+    const size_t n = size();
+    unit_t units[2 * max_units] = {};
+    std::copy(value, value + n, units);
+    reduce(result, units);
+}
+
+void BarrettContext::from_residue(unit_t* result, const unit_t* value) const
+{
+    std::copy(value, value + size(), result);
+}
+
+const BarrettContext::unit_t* BarrettContext::one() const
+{
+    return m_one.data();
+}
+
+BigInteger BarrettContext::pow_mod(const BigInteger& base, const BigInteger& exponent) const
+{
+    return window_pow_mod(*this, base, exponent);
+}
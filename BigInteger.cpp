@@ -1,8 +1,9 @@
 #include <stdexcept>
-#include <iterator>
 #include <algorithm>
 
 #include "BigInteger.h"
+#include "MontgomeryContext.h"
+#include "Scratch.h"
 
 BigInteger::BigInteger()
     : m_sign(true)
@@ -25,16 +26,17 @@ BigInteger::BigInteger(const std::string& value)
 		    return;
 		}
     }
-	m_sign = sign;
     if (apply) {
         *this = std::move(tmp);
+        m_sign = sign || m_value.empty();
     }
 }
 
 bool BigInteger::operator== (const BigInteger& rhs) const
 {
-    return m_sign == rhs.m_sign
-        && m_value == rhs.m_value;
+    const size_t size = unit_count();
+    return size == rhs.unit_count() && m_sign == rhs.m_sign
+        && limbs::eq_n(m_value.data(), rhs.m_value.data(), size);
 }
 
 bool BigInteger::operator!= (const BigInteger& rhs) const
@@ -62,189 +64,169 @@ bool BigInteger::operator>= (const BigInteger& rhs) const
     return compare<false, true>(*this, rhs);
 }
 
-BigInteger BigInteger::operator+ (const BigInteger& rhs) const
+BigInteger BigInteger::operator+ (const BigInteger& rhs) const &
 {
     BigInteger result;
+    result.m_value.reserve(std::max(m_value.size(), rhs.m_value.size()) + 1);
+    result = *this;
+    result += rhs;
+    return result;
+}
 
-    const auto& lhs = *this;
-    if ((lhs.m_sign && rhs.m_sign) || (!lhs.m_sign && !rhs.m_sign)) {
-        const auto max_degree = std::max(lhs.m_value.size(), rhs.m_value.size());
-        result.m_value.reserve(max_degree);
-        big_unit_t remainder = 0;
-        for (int i = 0; i < max_degree; ++i) {
-            big_unit_t tmp = big_unit_t(lhs.get_unit(i)) +
-                big_unit_t(rhs.get_unit(i)) +
-                remainder;
-            result.set_unit(i, tmp % ((uint32_t)max_unit_value + 1));
-            remainder = tmp / ((uint32_t)max_unit_value + 1);
-        }
-        if (remainder != 0) {
-            result.set_unit(max_degree, remainder % ((uint32_t)max_unit_value + 1));
-        }
-        result.m_sign = lhs.m_sign;
-    } else if (lhs.m_sign && !rhs.m_sign) {
-        return lhs - (-rhs);
-    } else if (!lhs.m_sign && rhs.m_sign) {
-        return rhs - (-lhs);
-    }
-    
-    result.refresh();
-    return std::move(result);
+BigInteger BigInteger::operator+ (const BigInteger& rhs) &&
+{
+    *this += rhs;
+    return std::move(*this);
 }
 
-BigInteger BigInteger::operator- (const BigInteger& rhs) const
+BigInteger BigInteger::operator- (const BigInteger& rhs) const &
 {
     BigInteger result;
+    result.m_value.reserve(std::max(m_value.size(), rhs.m_value.size()) + 1);
+    result = *this;
+    result -= rhs;
+    return result;
+}
 
-    const auto& lhs = *this;
-    if ((lhs.m_sign && rhs.m_sign) || (!lhs.m_sign && !rhs.m_sign)) {
-        if (!lhs.m_sign) {
-            result = (-lhs) - (-rhs);
-            result.m_sign = false;
-        } else {
-            if (lhs < rhs) {
-                result = rhs - lhs;
-            } else {
-                const auto max_degree = lhs.m_value.size();
-                result = lhs + rhs.complement(max_degree) + 1;
-                result.set_unit(max_degree, 0);
-                result.m_sign = true;
-            }
-        }
-    } else if (lhs.m_sign && !rhs.m_sign) {
-        return lhs + (-rhs);
-    } else if (!lhs.m_sign && rhs.m_sign) {
-        return rhs + (-lhs);
-    }
-    
-    result.refresh();
-    return std::move(result);
+BigInteger BigInteger::operator- (const BigInteger& rhs) &&
+{
+    *this -= rhs;
+    return std::move(*this);
 }
 
 BigInteger BigInteger::operator- () const
 {
     BigInteger result(*this);
-    if (result != 0) {
+    if (!result.m_value.empty()) {
         result.m_sign = !result.m_sign;
     }
-    return std::move(result);
+    return result;
 }
 
-BigInteger BigInteger::operator* (const BigInteger& rhs) const
+BigInteger BigInteger::operator* (const BigInteger& rhs) const &
 {
     const auto& lhs = *this;
     if (lhs == 0 || rhs == 0) {
         return 0;
     }
 
-    uint64_t lhs_right = 0;
-    uint64_t rhs_right = 0;
-    const auto uint_size = sizeof(uint32_t) / sizeof(unit_t);
-    for (int i = 0; i < uint_size; ++i) {
-        lhs_right += (uint64_t)lhs.get_unit(i) * (uint64_t)std::pow((uint32_t)max_unit_value + 1, i);
-        rhs_right += (uint64_t)rhs.get_unit(i) * (uint64_t)std::pow((uint32_t)max_unit_value + 1, i);
-    }
-    BigInteger lhs_left;
-    BigInteger rhs_left;
-    if (lhs.m_value.size() > uint_size) {
-        lhs_left.m_value.assign(lhs.m_value.begin() + uint_size, lhs.m_value.end());
-    }
-    if (rhs.m_value.size() > uint_size) {
-        rhs_left.m_value.assign(rhs.m_value.begin() + uint_size, rhs.m_value.end());
-    }
-    
-    BigInteger tmp_third_part = lhs_left * rhs_left;
-    BigInteger third_part;
-    third_part.m_value.reserve(2 * uint_size + tmp_third_part.m_value.size());
-    for (int i = 0; i < 2 * uint_size; ++i) {
-        third_part.m_value.push_back(0);
-    }
-    std::copy(tmp_third_part.m_value.begin(), tmp_third_part.m_value.end(), std::back_inserter(third_part.m_value));
-    third_part.refresh();
-
-    lhs_left.multiply_by(rhs_right);
-    rhs_left.multiply_by(lhs_right);
-    BigInteger tmp_second_part = lhs_left + rhs_left;
-    BigInteger second_part;
-    second_part.m_value.reserve(uint_size + tmp_second_part.m_value.size());
-    for (int i = 0; i < uint_size; ++i) {
-        second_part.m_value.push_back(0);
-    }
-    std::copy(tmp_second_part.m_value.begin(), tmp_second_part.m_value.end(), std::back_inserter(second_part.m_value));
-    second_part.refresh();
-
-    BigInteger first_part(lhs_right * rhs_right);
-    
-    BigInteger result = first_part + second_part + third_part;
+    if (&lhs == &rhs) {
+        return square();
+    }
+
+    const size_t lhs_size = lhs.unit_count();
+    const size_t rhs_size = rhs.unit_count();
+    BigInteger result;
+    result.m_value.resize(lhs_size + rhs_size);
+    if (lhs_size >= rhs_size) {
+        limbs::mul(result.m_value.data(), lhs.m_value.data(), lhs_size, rhs.m_value.data(), rhs_size);
+    } else {
+        limbs::mul(result.m_value.data(), rhs.m_value.data(), rhs_size, lhs.m_value.data(), lhs_size);
+    }
     result.m_sign = (lhs.m_sign == rhs.m_sign);
     result.refresh();
-    return std::move(result);
+    return result;
 }
 
-BigInteger BigInteger::operator/ (const BigInteger& rhs) const
+BigInteger BigInteger::operator* (const BigInteger& rhs) &&
 {
-    if (rhs == 0) {
-        throw std::overflow_error("Divide by zero error.");
-    }
-    const auto& lhs = *this;
-    if (!lhs.m_sign && rhs.m_sign) {
-        return -((-lhs) / rhs);
-    } else if (lhs.m_sign && !rhs.m_sign) {
-        return -(lhs / (-rhs));
-    } else if (!lhs.m_sign && !rhs.m_sign) {
-        return (-lhs) / (-rhs);
-    }
-
-    BigInteger quotient;
-    BigInteger remainder;
-    for (int i = lhs.m_value.size() * 8 - 1; i >= 0; --i) {
-        remainder *= 2;
-        remainder.set_unit(0, remainder.get_unit(0) + ((lhs.get_unit(i / 8) / (unit_t)std::pow(2, i % 8)) % 2));
-        if (remainder >= rhs) {
-            remainder -= rhs;
-            quotient.set_unit(i / 8, quotient.get_unit(i / 8) + (unit_t)std::pow(2, i % 8));
-        }
+    *this *= rhs;
+    return std::move(*this);
+}
+
+BigInteger BigInteger::square() const
+{
+    const size_t size = unit_count();
+    BigInteger result;
+    if (size == 0) {
+        return result;
     }
-    quotient.refresh();
-    return std::move(quotient);
+    result.m_value.resize(2 * size);
+    limbs::sqr(result.m_value.data(), m_value.data(), size);
+    result.refresh();
+    return result;
+}
+
+BigInteger BigInteger::operator/ (const BigInteger& rhs) const &
+{
+    BigInteger result(*this);
+    result /= rhs;
+    return result;
+}
+
+BigInteger BigInteger::operator/ (const BigInteger& rhs) &&
+{
+    *this /= rhs;
+    return std::move(*this);
+}
+
+BigInteger BigInteger::operator% (const BigInteger& rhs) const &
+{
+    BigInteger result(*this);
+    result %= rhs;
+    return result;
+}
+
+BigInteger BigInteger::operator% (const BigInteger& rhs) &&
+{
+    *this %= rhs;
+    return std::move(*this);
+}
+
+BigInteger BigInteger::operator<< (const size_t bits) const
+{
+    BigInteger result(*this);
+    result <<= bits;
+    return result;
 }
 
-BigInteger BigInteger::operator% (const BigInteger& rhs) const
+BigInteger BigInteger::operator>> (const size_t bits) const
 {
-    if (rhs == 0) {
+    BigInteger result(*this);
+    result >>= bits;
+    return result;
+}
+
+std::pair<BigInteger, BigInteger> BigInteger::divmod(const BigInteger& rhs) const
+{
+    const size_t rhs_size = rhs.unit_count();
+    if (rhs_size == 0) {
         throw std::overflow_error("Divide by zero error.");
     }
     const auto& lhs = *this;
-    if (!lhs.m_sign && rhs.m_sign) {
-        return -((-lhs) % rhs);
-    } else if (lhs.m_sign && !rhs.m_sign) {
-        return -(lhs % (-rhs));
-    } else if (!lhs.m_sign && !rhs.m_sign) {
-        return (-lhs) % (-rhs);
-    }
-
-    BigInteger quotient;
-    BigInteger remainder;
-    for (int i = lhs.m_value.size() * 8 - 1; i >= 0; --i) {
-        remainder *= 2;
-        remainder.set_unit(0, remainder.get_unit(0) + ((lhs.get_unit(i / 8) / (unit_t)std::pow(2, i % 8)) % 2));
-        if (remainder >= rhs) {
-            remainder -= rhs;
-            quotient.set_unit(i / 8, quotient.get_unit(i / 8) + (unit_t)std::pow(2, i % 8));
-        }
+    const size_t lhs_size = lhs.unit_count();
+    std::pair<BigInteger, BigInteger> result;
+    auto& [ quotient, remainder ] = result;
+    if (lhs_size < rhs_size) {
+        remainder = lhs;
+        remainder.m_sign = true;
+    } else if (rhs_size == 1) {
+        quotient.m_value.resize(lhs_size);
+        remainder.set_unit(0, limbs::divrem_1(quotient.m_value.data(), lhs.m_value.data(), lhs_size, rhs.m_value[0]));
+    } else {
+        quotient.m_value.resize(lhs_size - rhs_size + 1);
+        remainder.m_value.resize(rhs_size);
+        limbs::divrem(quotient.m_value.data(), remainder.m_value.data(),
+                      lhs.m_value.data(), lhs_size, rhs.m_value.data(), rhs_size);
     }
+    quotient.refresh();
     remainder.refresh();
-    return std::move(remainder);
+    // Both are negative when the signs differ, and zero is never negative.
+    quotient.m_sign = quotient.m_value.empty() || lhs.m_sign == rhs.m_sign;
+    remainder.m_sign = remainder.m_value.empty() || lhs.m_sign == rhs.m_sign;
+    return result;
 }
 
 BigInteger BigInteger::operator^ (const BigInteger& rhs) const
 {
     BigInteger result(1);
-    for (BigInteger i = 0; i < rhs; ++i) {
-        if (rhs.m_sign) {
+    if (!rhs.m_sign) {
+        return result;
+    }
+    for (size_t i = rhs.bit_length(); i != 0; --i) {
+        result *= result;
+        if (rhs.test_bit(i - 1)) {
             result *= *this;
-        } else {
-            result /= *this;
         }
     }
     return result;
@@ -252,37 +234,107 @@ BigInteger BigInteger::operator^ (const BigInteger& rhs) const
 
 BigInteger& BigInteger::operator+= (const BigInteger& that)
 {
-    *this = *this + that;
-    return *this;
+    return add(that, that.m_sign);
 }
 
 BigInteger& BigInteger::operator-= (const BigInteger& that)
 {
-    *this = *this - that;
-    return *this;
+    return add(that, !that.m_sign);
 }
 
 BigInteger& BigInteger::operator*= (const BigInteger& that)
 {
-    *this = *this * that;
+    const size_t size = unit_count();
+    const size_t that_size = that.unit_count();
+    if (size == 0 || that_size == 0) {
+        m_value.clear();
+        m_sign = true;
+        return *this;
+    }
+
+    // The product is formed on the stack when it fits and copied back into this storage.
+    unit_t local[256];
+    ScratchScope scope;
+    unit_t* product = size + that_size <= 256 ? local : scope.allocate(size + that_size);
+    if (&that == this) {
+        limbs::sqr(product, m_value.data(), size);
+    } else if (size >= that_size) {
+        limbs::mul(product, m_value.data(), size, that.m_value.data(), that_size);
+    } else {
+        limbs::mul(product, that.m_value.data(), that_size, m_value.data(), size);
+    }
+    m_value.assign(product, product + size + that_size);
+    m_sign = (m_sign == that.m_sign);
+    refresh();
     return *this;
 }
 
 BigInteger& BigInteger::operator/= (const BigInteger& that)
 {
-    *this = *this / that;
+    divide(that, true);
     return *this;
 }
 
 BigInteger& BigInteger::operator%= (const BigInteger& that)
 {
-    *this = *this % that;
+    divide(that, false);
+    return *this;
+}
+
+BigInteger& BigInteger::operator<<= (const size_t bits)
+{
+    const size_t size = unit_count();
+    if (size == 0) {
+        return *this;
+    }
+    const size_t words = bits / unit_bits;
+    const unsigned shift = bits % unit_bits;
+    m_value.resize(size + words + 1);
+    // From the top down, so every limb is read before it is overwritten.
+    for (size_t i = size + words + 1; i-- > words;) {
+        const size_t source = i - words;
+        unit_t unit = source < size ? m_value[source] << shift : 0;
+        if (shift != 0 && source != 0) {
+            unit |= m_value[source - 1] >> (unit_bits - shift);
+        }
+        m_value[i] = unit;
+    }
+    std::fill(m_value.begin(), m_value.begin() + words, 0);
+    refresh();
+    return *this;
+}
+
+BigInteger& BigInteger::operator>>= (const size_t bits)
+{
+    const size_t size = unit_count();
+    const size_t words = bits / unit_bits;
+    const unsigned shift = bits % unit_bits;
+    if (words >= size) {
+        m_value.clear();
+        m_sign = true;
+        return *this;
+    }
+    // From the bottom up, so every limb is read before it is overwritten.
+    for (size_t i = 0; i + words < size; ++i) {
+        unit_t unit = m_value[i + words] >> shift;
+        if (shift != 0 && i + words + 1 < size) {
+            unit |= m_value[i + words + 1] << (unit_bits - shift);
+        }
+        m_value[i] = unit;
+    }
+    m_value.resize(size - words);
+    refresh();
+    if (m_value.empty()) {
+        m_sign = true;
+    }
     return *this;
 }
 
 BigInteger& BigInteger::operator- ()
 {
-    m_sign = !m_sign;
+    if (!m_value.empty()) {
+        m_sign = !m_sign;
+    }
     return *this;
 }
 
@@ -293,36 +345,127 @@ BigInteger& BigInteger::operator++ ()
 
 BigInteger& BigInteger::operator-- ()
 {
-    *this -= 1;
-    refresh();
-    return *this;
+    return *this -= 1;
 }
 
 const BigInteger BigInteger::operator++ (int)
 {
     auto tmp = *this;
     ++(*this);
-    return std::move(tmp);
+    return tmp;
 }
 
 const BigInteger BigInteger::operator-- (int)
 {
     auto tmp = *this;
     --(*this);
-    refresh();
-    return std::move(tmp);
+    return tmp;
+}
+
+BigInteger BigInteger::pow_mod(const BigInteger& exponent, const BigInteger& modulus) const
+{
+    if (modulus == 0) {
+        throw std::overflow_error("Divide by zero error.");
+    }
+    if (!exponent.m_sign) {
+        throw std::domain_error("Negative exponent.");
+    }
+    const BigInteger abs_modulus = modulus.m_sign ? modulus : -modulus;
+    // Wider moduli than the context's stack buffers take the generic loop below.
+    if (abs_modulus.test_bit(0) && abs_modulus != 1 && abs_modulus.unit_count() <= MontgomeryContext::max_units) {
+        return MontgomeryContext(abs_modulus).pow_mod(*this, exponent);
+    }
+    BigInteger base = *this % abs_modulus;
+    if (!base.m_sign) {
+        base += abs_modulus;
+    }
+
+    const size_t exponent_bits = exponent.bit_length();
+    const size_t window = window_size(exponent_bits);
+
+    // odd_powers[i] = base ^ (2 * i + 1)
+    std::vector<BigInteger> odd_powers(size_t(1) << (window - 1));
+    odd_powers[0] = base;
+    if (odd_powers.size() > 1) {
+        const BigInteger base_squared = base.square() % abs_modulus;
+        for (size_t i = 1; i < odd_powers.size(); ++i) {
+            odd_powers[i] = (odd_powers[i - 1] * base_squared) % abs_modulus;
+        }
+    }
+
+    BigInteger result = BigInteger(1) % abs_modulus;
+    size_t i = exponent_bits;
+    while (i != 0) {
+        if (!exponent.test_bit(i - 1)) {
+            result *= result;
+            result %= abs_modulus;
+            --i;
+            continue;
+        }
+        size_t length = std::min(window, i);
+        while (!exponent.test_bit(i - length)) {
+            --length;
+        }
+        size_t value = 0;
+        for (size_t j = 0; j < length; ++j) {
+            value = (value << 1) | exponent.test_bit(i - 1 - j);
+            result *= result;
+            result %= abs_modulus;
+        }
+        result *= odd_powers[value >> 1];
+        result %= abs_modulus;
+        i -= length;
+    }
+    return result;
+}
+
+size_t BigInteger::bit_length() const
+{
+    const size_t degree = unit_count();
+    if (degree == 0) {
+        return 0;
+    }
+    size_t result = degree * unit_bits;
+    for (unit_t top = m_value[degree - 1]; (top >> (unit_bits - 1)) == 0; top <<= 1) {
+        --result;
+    }
+    return result;
+}
+
+bool BigInteger::test_bit(const size_t index) const
+{
+    return (get_unit(index / unit_bits) >> (index % unit_bits)) & 1;
+}
+
+size_t BigInteger::window_size(const size_t exponent_bits)
+{
+    size_t window = 1;
+    while (window < 6 && exponent_bits > (size_t(1) << (2 * window + 1))) {
+        ++window;
+    }
+    return window;
 }
 
 std::string BigInteger::to_string() const
 {
+    // Peels off 19 decimal digits per single-limb division.
+    const unit_t chunk = 10000000000000000000ull;
+    const int chunk_digits = 19;
+
     std::string result;
     BigInteger tmp(*this);
+    tmp.m_sign = true;
     if (tmp == 0) {
         result.push_back('0');
     } else {
         while (tmp != 0) {
-            result.push_back(int8_t((tmp % 10).to_integral<int8_t>() + 48));
-            tmp /= 10;
+            auto [ quotient, remainder ] = tmp.divmod(chunk);
+            unit_t digits = remainder.get_unit(0);
+            for (int i = 0; i < chunk_digits && (digits != 0 || quotient != 0); ++i) {
+                result.push_back(char('0' + digits % 10));
+                digits /= 10;
+            }
+            tmp = std::move(quotient);
         }
         if (!m_sign) {
             result.push_back('-');
@@ -332,14 +475,57 @@ std::string BigInteger::to_string() const
     return result;
 }
 
-std::vector<BigInteger::unit_t> BigInteger::raw_data() const
+std::vector<BigInteger::byte_t> BigInteger::raw_data() const
 {
-    return m_value;
+    std::vector<byte_t> result;
+    result.reserve(m_value.size() * sizeof(unit_t));
+    for (const auto unit : m_value) {
+        for (size_t i = 0; i < sizeof(unit_t); ++i) {
+            result.push_back(byte_t(unit >> (8 * i)));
+        }
+    }
+    while (!result.empty() && result.back() == 0) {
+        result.pop_back();
+    }
+    return result;
+}
+
+void BigInteger::set_raw_data(const std::vector<byte_t>& data)
+{
+    set_raw_data(data.data(), data.size());
+}
+
+void BigInteger::set_raw_data(const byte_t* data, const size_t size)
+{
+    m_value.assign((size + sizeof(unit_t) - 1) / sizeof(unit_t), 0);
+    for (size_t i = 0; i < size; ++i) {
+        m_value[i / sizeof(unit_t)] |= unit_t(data[i]) << (8 * (i % sizeof(unit_t)));
+    }
+    refresh();
+}
+
+size_t BigInteger::unit_count() const
+{
+    size_t degree = m_value.size();
+    while (degree != 0 && m_value[degree - 1] == 0) {
+        --degree;
+    }
+    return degree;
 }
 
-void BigInteger::set_raw_data(const std::vector<unit_t>& data)
+void BigInteger::to_units(unit_t* result, const size_t count) const
 {
-    m_value = data;
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = get_unit(i);
+    }
+}
+
+BigInteger BigInteger::from_units(const unit_t* units, const size_t count)
+{
+    BigInteger result;
+    result.m_value.assign(units, units + count);
+    result.refresh();
+    return result;
 }
 
 std::ostream& operator<< (std::ostream& os, const BigInteger& n)
@@ -378,30 +564,80 @@ void BigInteger::refresh()
     m_value.resize(index + 1);
 }
 
-BigInteger BigInteger::complement(const size_t degree) const
+BigInteger& BigInteger::add(const BigInteger& that, const bool that_sign)
 {
-    BigInteger result;
-    result.m_value.resize(degree);
-    for (int i = 0; i < degree; ++i) {
-        result.set_unit(i, max_unit_value - get_unit(i));
+    if (&that == this) {
+        if (that_sign == m_sign) {
+            return *this <<= 1;
+        }
+        m_value.clear();
+        m_sign = true;
+        return *this;
+    }
+
+    const size_t size = unit_count();
+    const size_t that_size = that.unit_count();
+    if (m_sign == that_sign) {
+        const size_t degree = std::max(size, that_size);
+        m_value.resize(degree + 1);
+        unit_t carry = limbs::add_n(m_value.data(), m_value.data(), that.m_value.data(), that_size);
+        for (size_t i = that_size; carry != 0; ++i) {
+            m_value[i] = limbs::add_carry(m_value[i], 0, carry);
+        }
+    } else if (compare_magnitude(*this, that) >= 0) {
+        unit_t borrow = limbs::sub_n(m_value.data(), m_value.data(), that.m_value.data(), that_size);
+        for (size_t i = that_size; borrow != 0; ++i) {
+            m_value[i] = limbs::sub_borrow(m_value[i], 0, borrow);
+        }
+    } else {
+        // |that| - |this|, which takes the sign of that.
+        m_value.resize(that_size);
+        unit_t borrow = limbs::sub_n(m_value.data(), that.m_value.data(), m_value.data(), size);
+        for (size_t i = size; i < that_size; ++i) {
+            m_value[i] = limbs::sub_borrow(that.m_value[i], 0, borrow);
+        }
+        m_sign = that_sign;
+    }
+    refresh();
+    if (m_value.empty()) {
+        m_sign = true;
     }
-    return std::move(result);
+    return *this;
 }
 
-void BigInteger::multiply_by(const uint64_t rhs)
+void BigInteger::divide(const BigInteger& that, const bool keep_quotient)
 {
-    BigInteger result;
-    for (int i = 0; i < m_value.size(); ++i) {
-        uint64_t sub_result = rhs * get_unit(i);
-        BigInteger tmp;
-        for (int j = i; j < i + sizeof(uint64_t) / sizeof(unit_t); ++j) {
-            tmp.set_unit(j, sub_result % ((int)max_unit_value + 1));
-            sub_result /= ((int)max_unit_value + 1);
+    const size_t that_size = that.unit_count();
+    if (that_size == 0) {
+        throw std::overflow_error("Divide by zero error.");
+    }
+    const size_t size = unit_count();
+    if (size < that_size) {
+        if (keep_quotient) {
+            m_value.clear();
+        }
+    } else if (that_size == 1) {
+        const unit_t remainder = limbs::divrem_1(m_value.data(), m_value.data(), size, that.m_value[0]);
+        if (!keep_quotient) {
+            m_value.assign(1, remainder);
         }
-        result += tmp;
+    } else {
+        limbs::divrem(keep_quotient ? m_value.data() : nullptr, keep_quotient ? nullptr : m_value.data(),
+                      m_value.data(), size, that.m_value.data(), that_size);
+        m_value.resize(keep_quotient ? size - that_size + 1 : that_size);
     }
-    result.refresh();
-    *this = result;
+    refresh();
+    m_sign = m_value.empty() || m_sign == that.m_sign;
+}
+
+int BigInteger::compare_magnitude(const BigInteger& lhs, const BigInteger& rhs)
+{
+    const size_t lhs_size = lhs.unit_count();
+    const size_t rhs_size = rhs.unit_count();
+    if (lhs_size != rhs_size) {
+        return lhs_size < rhs_size ? -1 : 1;
+    }
+    return limbs::cmp_n(lhs.m_value.data(), rhs.m_value.data(), lhs_size);
 }
 
 BigInteger::BaseDecoderResult BigInteger::decodeBase(const std::string& value, bool& ok)
@@ -423,6 +659,8 @@ BigInteger::BaseDecoderResult BigInteger::decodeBase(const std::string& value, b
     if (valueView[0] == '0') {
         valueView.remove_prefix(1);
         if (valueView.empty()) {
+            // Plain zero, no digits left to convert.
+            std::get<2>(result) = valueView;
             return result;
         }
 
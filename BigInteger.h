@@ -1,6 +1,5 @@
 #pragma once
 
-#include <cmath>
 #include <cstdint>
 #include <functional>
 #include <iostream>
@@ -10,13 +9,17 @@
 #include <string_view>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "LimbVector.h"
+#include "Limbs.h"
+
 class BigInteger
 {
 public:
-    typedef uint8_t unit_t;
-    typedef uint16_t big_unit_t;
+    typedef limbs::limb_t unit_t;
+    typedef uint8_t byte_t;
 
     BigInteger();
     explicit BigInteger(const std::string& value);
@@ -40,36 +43,70 @@ public:
     bool operator<= (const BigInteger& rhs) const;
     bool operator>= (const BigInteger& rhs) const;
 
-    BigInteger operator+ (const BigInteger& rhs) const;
-    BigInteger operator- (const BigInteger& rhs) const;
+    // The rvalue overloads compute into the left operand's storage, so chains like
+    // (a * b) % m allocate once rather than per operation.
+    BigInteger operator+ (const BigInteger& rhs) const &;
+    BigInteger operator+ (const BigInteger& rhs) &&;
+    BigInteger operator- (const BigInteger& rhs) const &;
+    BigInteger operator- (const BigInteger& rhs) &&;
     BigInteger operator-                      () const;
-    BigInteger operator* (const BigInteger& rhs) const;
-    BigInteger operator/ (const BigInteger& rhs) const;
-    BigInteger operator% (const BigInteger& rhs) const;
+    BigInteger operator* (const BigInteger& rhs) const &;
+    BigInteger operator* (const BigInteger& rhs) &&;
+    BigInteger operator/ (const BigInteger& rhs) const &;
+    BigInteger operator/ (const BigInteger& rhs) &&;
+    BigInteger operator% (const BigInteger& rhs) const &;
+    BigInteger operator% (const BigInteger& rhs) &&;
+    // Shifts of the magnitude, the sign is kept. Right shifts round toward zero like operator/.
+    BigInteger operator<< (const size_t bits) const;
+    BigInteger operator>> (const size_t bits) const;
+    // Quotient and remainder of one Knuth Algorithm D pass, with the signs of operator/ and operator%.
+    std::pair<BigInteger, BigInteger> divmod(const BigInteger& rhs) const;
     BigInteger operator^ (const BigInteger& rhs) const;
 
+    // In place: the storage is reused whenever it has the capacity for the result.
     BigInteger& operator+= (const BigInteger& that);
     BigInteger& operator-= (const BigInteger& that);
     BigInteger& operator*= (const BigInteger& that);
     BigInteger& operator/= (const BigInteger& that);
     BigInteger& operator%= (const BigInteger& that);
+    BigInteger& operator<<= (const size_t bits);
+    BigInteger& operator>>= (const size_t bits);
     BigInteger& operator- ();
     BigInteger& operator++ ();
     BigInteger& operator-- ();
     const BigInteger operator++ (int);
     const BigInteger operator-- (int);
 
+    // Same as *this * *this, using the squaring kernels that compute each cross product once.
+    BigInteger square() const;
+    // Computes (*this ^ exponent) % modulus with sliding-window square-and-multiply,
+    // reducing after every step. The result lies in [0, modulus).
+    BigInteger pow_mod(const BigInteger& exponent, const BigInteger& modulus) const;
+    size_t bit_length() const;
+    bool test_bit(const size_t index) const;
+    // Sliding window width used by the modular exponentiations for an exponent of this many bits.
+    static size_t window_size(const size_t exponent_bits);
+
     std::string to_string() const;
-    std::vector<unit_t> raw_data() const;
-    void set_raw_data(const std::vector<unit_t>& data);
+    std::vector<byte_t> raw_data() const;
+    // Limb level access for the modular arithmetic contexts: unit_count() is the number of
+    // significant limbs, to_units() writes the low count limbs of the magnitude zero-padded.
+    size_t unit_count() const;
+    void to_units(unit_t* result, const size_t count) const;
+    static BigInteger from_units(const unit_t* units, const size_t count);
+    void set_raw_data(const std::vector<byte_t>& data);
+    void set_raw_data(const byte_t* data, const size_t size);
     friend std::ostream& operator<< (std::ostream& os, const BigInteger& n);
 
 private:
     void set_unit(const size_t index, const unit_t unit_value);
     unit_t get_unit(const size_t index) const;
     void refresh();
-    BigInteger complement(const size_t degree) const;
-    void multiply_by(const uint64_t rhs);
+    // *this += that with that's sign taken as that_sign, for both += and -=.
+    BigInteger& add(const BigInteger& that, const bool that_sign);
+    // Quotient or remainder in place, with the signs of operator/ and operator%.
+    void divide(const BigInteger& that, const bool keep_quotient);
+    static int compare_magnitude(const BigInteger& lhs, const BigInteger& rhs);
 
     template <bool LESS, bool EQUAL>
     static bool compare(const BigInteger& lhs, const BigInteger& rhs);
@@ -84,70 +121,54 @@ private:
     static int charToInt16(char, bool& ok);
 
 private:
-    std::vector<unit_t> m_value;
+    LimbVector m_value;
     bool m_sign;
     static const unit_t max_unit_value = std::numeric_limits<unit_t>::max();
+    static const size_t unit_bits = std::numeric_limits<unit_t>::digits;
 };
 
 template <typename T>
 BigInteger::BigInteger(T value, typename std::enable_if<std::is_integral<T>::value>::type*)
     : m_sign(value >= 0)
 {
-    for (int i = 0; i < sizeof(T) / sizeof(unit_t); ++i) {
-        set_unit(i, value % ((uint32_t)max_unit_value + 1));
-        value /= ((uint32_t)max_unit_value + 1);
+    using UnsignedT = typename std::make_unsigned<T>::type;
+    UnsignedT magnitude = m_sign ? UnsignedT(value) : UnsignedT(0) - UnsignedT(value);
+    for (size_t i = 0; i < (sizeof(T) + sizeof(unit_t) - 1) / sizeof(unit_t); ++i) {
+        set_unit(i, unit_t(magnitude));
+        if constexpr (sizeof(UnsignedT) > sizeof(unit_t)) {
+            magnitude >>= unit_bits;
+        }
     }
 }
 
-#define max(a, b) ((a) > (b) ? (a) : (b))
 #define min(a, b) ((a) > (b) ? (b) : (a))
 
 template <typename T>
 T BigInteger::to_integral(typename std::enable_if<std::is_integral<T>::value>::type*) const
 {
-    T result = 0;
-    for (int i = 0; i < min(sizeof(T) / sizeof(unit_t), m_value.size()); ++i) {
-        result += std::pow(((uint32_t)max_unit_value + 1), i) * get_unit(i);
+    using UnsignedT = typename std::make_unsigned<T>::type;
+    UnsignedT result = 0;
+    const size_t units = (sizeof(T) + sizeof(unit_t) - 1) / sizeof(unit_t);
+    for (size_t i = min(units, m_value.size()); i != 0; --i) {
+        if constexpr (sizeof(UnsignedT) > sizeof(unit_t)) {
+            result <<= unit_bits;
+        }
+        result |= UnsignedT(get_unit(i - 1));
     }
-    return m_sign ? result : -result;
+    return T(m_sign ? result : UnsignedT(0) - result);
 }
 
 template <bool LESS, bool EQUAL>
 bool BigInteger::compare(const BigInteger& lhs, const BigInteger& rhs)
 {
-    if (lhs.m_sign && rhs.m_sign) {
-        const size_t max_degree = max(lhs.m_value.size(), rhs.m_value.size());
-        size_t degree = max_degree;
-        while (degree != 0) {
-            --degree;
-            if (lhs.get_unit(degree) < rhs.get_unit(degree)) {
-                return LESS;
-            } else if (lhs.get_unit(degree) < rhs.get_unit(degree)) {
-                return !LESS;
-            }
-        }
-        return EQUAL;
-    } else if (!lhs.m_sign && rhs.m_sign) {
-        return LESS;
-    } else if (lhs.m_sign && !rhs.m_sign) {
-        return !LESS;
-    } else {
-        const auto max_degree = max(lhs.m_value.size(), rhs.m_value.size());
-        auto degree = max_degree;
-        while (degree != 0) {
-            --degree;
-            if (lhs.get_unit(degree) < rhs.get_unit(degree)) {
-                return !LESS;
-            } else if (lhs.get_unit(degree) < rhs.get_unit(degree)) {
-                return LESS;
-            }
-        }
-        return EQUAL;
+    if (lhs.m_sign != rhs.m_sign) {
+        return lhs.m_sign ? !LESS : LESS;
     }
-    return false;
+    // Magnitudes are compared by limbs::cmp_n, reversed for two negatives.
+    const int order = lhs.m_sign ? compare_magnitude(lhs, rhs) : compare_magnitude(rhs, lhs);
+    return order == 0 ? EQUAL : (order < 0) == LESS;
 }
 
-#undef max
 #undef min
 
 namespace std {
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+namespace E2EE {
+
+// Lock-free bounded multi-producer multi-consumer queue (Vyukov). Every cell carries a sequence
+// number telling whether it is ready for the producer or the consumer of a given lap, so
+// tryPush and tryPop each claim a cell with a single compare-and-swap and never block.
+template <typename T>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to a power of two.
+    explicit BoundedQueue(size_t capacity)
+        : m_mask(0)
+        , m_enqueue(0)
+        , m_dequeue(0)
+    {
+        if (capacity == 0) {
+            throw std::invalid_argument("Queue capacity must be positive.");
+        }
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // Approximate under concurrent use.
+    size_t size() const
+    {
+        const size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+        const size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    // Returns false if the queue is full.
+    bool tryPush(T value)
+    {
+        size_t position = m_enqueue.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[position & m_mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t lag = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+            if (lag == 0) {
+                if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                position = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty.
+    bool tryPop(T& value)
+    {
+        size_t position = m_dequeue.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[position & m_mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t lag = std::ptrdiff_t(sequence) - std::ptrdiff_t(position + 1);
+            if (lag == 0) {
+                if (m_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                position = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T                   value;
+    };
+
+    std::unique_ptr<Cell[]>          m_cells;
+    size_t                           m_mask;
+    alignas(64) std::atomic<size_t>  m_enqueue;
+    alignas(64) std::atomic<size_t>  m_dequeue;
+};
+
+} // namespace E2EE
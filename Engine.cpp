@@ -1,97 +1,1140 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
 #include "Engine.h"
 
 using namespace E2EE;
 
-SINGLETON_DEF(Engine)
-
-Engine::Engine()
-    : m_prime("0x" "FFFFFFFF" "FFFFFFFF" "C90FDAA2" "2168C234" "C4C6628B" "80DC1CD1"
-                   "29024E08" "8A67CC74" "020BBEA6" "3B139B22" "514A0879" "8E3404DD"
-                   "EF9519B3" "CD3A431B" "302B0A6D" "F25F1437" "4FE1356D" "6D51C245"
-                   "E485B576" "625E7EC6" "F44C42E9" "A637ED6B" "0BFF5CB6" "F406B7ED"
-                   "EE386BFB" "5A899FA5" "AE9F2411" "7C4B1FE6" "49286651" "ECE45B3D"
-                   "C2007CB8" "A163BF05" "98DA4836" "1C55D39A" "69163FA8" "FD24CF5F"
-                   "83655D23" "DCA3AD96" "1C62F356" "208552BB" "9ED52907" "7096966D"
-                   "670C354E" "4ABC9804" "F1746C08" "CA18217C" "32905E46" "2E36CE3B"
-                   "E39E772C" "180E8603" "9B2783A2" "EC07A28F" "B5C55DF0" "6F4C52C9"
-                   "DE2BCBF6" "95581718" "3995497C" "EA956AE5" "15D22618" "98FA0510"
-                   "15728E5A" "8AAAC42D" "AD33170D" "04507A33" "A85521AB" "DF1CBA64"
-                   "ECFB8504" "58DBEF0A" "8AEA7157" "5D060C7D" "B3970F85" "A6E1E4C7"
-                   "ABF5AE8C" "DB0933D7" "1E8C94E0" "4A25619D" "CEE3D226" "1AD2EE6B"
-                   "F12FFA06" "D98A0864" "D8760273" "3EC86A64" "521F2B18" "177B200C"
-                   "BBE11757" "7A615D6C" "770988C0" "BAD946E2" "08E24FA0" "74E5AB31"
-                   "43DB5BFC" "E0FD108E" "4B82D120" "A93AD2CA" "FFFFFFFF" "FFFFFFFF")
-    , m_generator(2)
+namespace {
+
+// Records of the first snapshot format are a name and a value, each a native uint32 length
+// followed by that many bytes. scanRecords checks the bounds that these rely on.
+uint32_t recordLength(const Byte* data)
+{
+    uint32_t length = 0;
+    std::memcpy(&length, data, sizeof(length));
+    return length;
+}
+
+std::string_view recordName(const Byte* record)
+{
+    return std::string_view(reinterpret_cast<const char*>(record + 4), recordLength(record));
+}
+
+GroupParameters::Residue recordValue(const Byte* record)
+{
+    const Byte* value = record + 4 + recordLength(record);
+    const uint32_t length = recordLength(value);
+    GroupParameters::Residue result;
+    for (uint32_t i = 0; i < length; ++i) {
+        result[i / 8] |= GroupParameters::Residue::unit_t(value[4 + i]) << (8 * (i % 8));
+    }
+    return result;
+}
+
+// Reads a count and the offsets of that many records starting at position, and moves position
+// past them. Returns false if they do not fit in size.
+bool scanRecords(const Byte* data, size_t size, size_t& position, std::vector<size_t>& offsets)
+{
+    if (size - position < 4) {
+        return false;
+    }
+    const uint32_t count = recordLength(data + position);
+    position += 4;
+    // A record takes at least eight bytes.
+    offsets.reserve(std::min<size_t>(count, (size - position) / 8));
+    for (uint32_t i = 0; i < count; ++i) {
+        offsets.push_back(position);
+        for (size_t field = 0; field < 2; ++field) {
+            if (size - position < 4) {
+                return false;
+            }
+            const uint32_t length = recordLength(data + position);
+            position += 4;
+            if (size - position < length || (field == 1 && length > GroupParameters::Residue::units * 8)) {
+                return false;
+            }
+            position += length;
+        }
+    }
+    return true;
+}
+
+// Whether MapT::find takes a std::string_view as is: FlatMap, and std::unordered_map with a
+// transparent hash and C++20 heterogeneous lookup.
+template <typename MapT, typename = void>
+struct has_view_lookup : std::false_type
+{};
+
+template <typename MapT>
+struct has_view_lookup<MapT, decltype(void(std::declval<MapT&>().find(std::string_view())))> : std::true_type
+{};
+
+template <typename MapT>
+auto findUser(MapT& map, std::string_view user) -> decltype(map.begin())
+{
+    if constexpr (has_view_lookup<MapT>::value) {
+        return map.find(user);
+    } else {
+        return map.find(std::string(user));
+    }
+}
+
+template <typename MapT>
+bool containsUser(const MapT& map, std::string_view user)
+{
+    return findUser(map, user) != map.end();
+}
+
+template <typename MapT>
+void eraseUser(MapT& map, std::string_view user)
+{
+    const auto it = findUser(map, user);
+    if (it != map.end()) {
+        map.erase(it);
+    }
+}
+
+void checkOutput(Span<Byte> out)
+{
+    if (out.size() < snapshot::valueSize) {
+        throw std::length_error("Buffer too small for a value.");
+    }
+}
+
+void writeValue(const GroupParameters::Residue& value, Span<Byte> out)
+{
+    checkOutput(out);
+    for (size_t i = 0; i < GroupParameters::Residue::units; ++i) {
+        snapshot::storeLittle(out.data() + 8 * i, value[i], 8);
+    }
+}
+
+// The journals a batch appended to, each with its last sequence. Batches take the journal under
+// each shard lock in turn, and it may be replaced in between.
+using JournalCommits = std::vector<std::pair<std::shared_ptr<Journal>, uint64_t>>;
+
+void noteAppend(JournalCommits& commits, const std::shared_ptr<Journal>& journal, uint64_t sequence)
+{
+    if (commits.empty() || commits.back().first != journal) {
+        commits.emplace_back(journal, sequence);
+    } else {
+        commits.back().second = sequence;
+    }
+}
+
+void commitAll(const JournalCommits& commits)
+{
+    for (const auto& commit : commits) {
+        commit.first->commit(commit.second);
+    }
+}
+
+} // namespace
+
+DEFAULT_INSTANCE_DEF(Engine)
+
+Engine::Engine(std::shared_ptr<const GroupParameters> group)
+    : m_group(std::move(group))
+    , m_reduction(Reduction::SpecialForm)
     , m_gen(std::random_device()())
     , m_dis(40.0, 20.0)
 {
+    if (!m_group) {
+        throw std::invalid_argument("Engine needs group parameters.");
+    }
 }
 
 Engine::~Engine()
 {
+    // The pool thread calls back into this object, stop it while all members are alive.
+    disableKeyPool();
+}
+
+const std::shared_ptr<const GroupParameters>& Engine::group() const
+{
+    return m_group;
+}
+
+bool Engine::prepareToPairWith(std::string_view user, bool computeKey)
+{
+    Shard& shard = shardFor(user);
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (isKnown(shard, user)) {
+            return false;
+        }
+    }
+    const PendingKey key = makePendingKey(computeKey);
+
+    // Journaled under the lock so that the journal has the changes of a user in order, and
+    // committed after it so that concurrent calls share the sync. The journal is taken under
+    // the lock too, as openJournal and resetState replace it under every shard lock. The record
+    // is appended first, so a name the journal rejects leaves the state unchanged.
+    std::shared_ptr<Journal> journal;
+    uint64_t sequence = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (isKnown(shard, user)) {
+            return false;
+        }
+        journal = this->journal();
+        if (journal) {
+            sequence = journal->append(Journal::Type::Prepare, user, key.exponent);
+        }
+        shard.temporary.insert(std::make_pair(std::string(user), key));
+    }
+    if (journal) {
+        journal->commit(sequence);
+    }
+    return true;
+}
+
+BigInteger Engine::getKeyToSend(std::string_view user) const
+{
+    const Shard& shard = shardFor(user);
+    Residue exponent;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        PendingKey key;
+        if (!findTemporary(shard, user, key)) {
+            return BigInteger();
+        }
+        if (key.hasPublicKey) {
+            return key.publicKey.to_big_integer();
+        }
+        exponent = key.exponent;
+    }
+    const Residue publicKey = powGenerator(exponent);
+
+    // Remember the key unless the handshake was completed or restarted in the meantime.
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        PendingKey* key = unpackTemporary(shard, user);
+        if (key != nullptr && key->exponent == exponent) {
+            key->publicKey = publicKey;
+            key->hasPublicKey = true;
+        }
+    }
+    return publicKey.to_big_integer();
+}
+
+void Engine::setReceivedKey(std::string_view user, const BigInteger& key)
+{
+    Shard& shard = shardFor(user);
+    Residue power;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        PendingKey pending;
+        if (!findTemporary(shard, user, pending)) {
+            return;
+        }
+        power = pending.exponent;
+    }
+    const Residue hash = powMod(reduce(key), power);
+
+    // The first of concurrent calls for the same handshake wins, like sequential calls would.
+    std::shared_ptr<Journal> journal;
+    uint64_t sequence = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        const PendingKey* pending = unpackTemporary(shard, user);
+        if (pending == nullptr || pending->exponent != power) {
+            return;
+        }
+        journal = this->journal();
+        if (journal) {
+            sequence = journal->append(Journal::Type::Complete, user, hash);
+        }
+        eraseUser(shard.temporary, user);
+        shard.permanent.insert(std::make_pair(std::string(user), hash));
+    }
+    if (journal) {
+        journal->commit(sequence);
+    }
+}
+
+BigInteger Engine::getHash(std::string_view user) const
+{
+    const Shard& shard = shardFor(user);
+    Residue hash;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (!findPermanent(shard, user, hash)) {
+            return BigInteger();
+        }
+    }
+    return hash.to_big_integer();
 }
 
-bool Engine::prepareToPairWith(const std::string& user)
+const Engine::Residue* Engine::findHash(std::string_view user) const
 {
-    if (m_permanent.find(user) != m_permanent.end()) {
+    // Hashes are never changed or erased short of replacing the state, and map entries do not
+    // move on insertion, so the pointer outlives the lock.
+    const Shard& shard = shardFor(user);
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const auto it = findUser(shard.permanent, user);
+        if (it != shard.permanent.end()) {
+            return &it->second;
+        }
+        if (!m_mapped) {
+            return nullptr;
+        }
+    }
+    // A mapped hash is encoded, so it is copied into the shard first.
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    return unpackPermanent(shard, user);
+}
+
+bool Engine::getHash(std::string_view user, Span<Byte> out) const
+{
+    checkOutput(out);
+    const Shard& shard = shardFor(user);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const auto it = findUser(shard.permanent, user);
+    if (it != shard.permanent.end()) {
+        writeValue(it->second, out);
+        return true;
+    }
+    // Mapped values are already in the output encoding.
+    size_t index = 0;
+    if (!m_mapped || !m_mapped->view().find(snapshot::Table::Permanent, user, index)) {
+        return false;
+    }
+    std::memcpy(out.data(), m_mapped->view().encodedValue(snapshot::Table::Permanent, index), valueSize);
+    return true;
+}
+
+bool Engine::getKeyToSend(std::string_view user, Span<Byte> out) const
+{
+    checkOutput(out);
+    const Shard& shard = shardFor(user);
+    Residue exponent;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        PendingKey key;
+        if (!findTemporary(shard, user, key)) {
+            return false;
+        }
+        if (key.hasPublicKey) {
+            writeValue(key.publicKey, out);
+            return true;
+        }
+        exponent = key.exponent;
+    }
+    const Residue publicKey = powGenerator(exponent);
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        PendingKey* key = unpackTemporary(shard, user);
+        if (key != nullptr && key->exponent == exponent) {
+            key->publicKey = publicKey;
+            key->hasPublicKey = true;
+        }
+    }
+    writeValue(publicKey, out);
+    return true;
+}
+
+ByteArray Engine::serialize() const
+{
+    ByteArray result;
+    ByteSink sink(result);
+    writeSnapshot(sink);
+    return result;
+}
+
+bool Engine::deserialize(const ByteArray& data)
+{
+    if (snapshot::hasMagic(data.data(), data.size())) {
+        snapshot::View view;
+        return view.open(data.data(), data.size(), true) && readSnapshot(view);
+    }
+    return readSnapshot(data.data(), data.size());
+}
+
+bool Engine::serialize(std::ostream& stream) const
+{
+    ByteSink sink(stream);
+    writeSnapshot(sink);
+    return sink.flush();
+}
+
+bool Engine::deserialize(std::istream& stream)
+{
+    ByteSource source(stream);
+    return readSnapshot(source);
+}
+
+void Engine::writeSnapshot(ByteSink& sink) const
+{
+    const auto locks = lockShardsShared();
+    uint32_t temporaryCount = 0;
+    uint32_t permanentCount = 0;
+    for (const Shard& shard : m_shards) {
+        temporaryCount += static_cast<uint32_t>(shard.temporary.size());
+        permanentCount += static_cast<uint32_t>(shard.permanent.size());
+    }
+
+    const snapshot::View* mapped = m_mapped ? &m_mapped->view() : nullptr;
+    if (mapped != nullptr) {
+        for (size_t i = 0; i < mapped->count(snapshot::Table::Temporary); ++i) {
+            temporaryCount += !isShadowed(mapped->name(snapshot::Table::Temporary, i));
+        }
+        for (size_t i = 0; i < mapped->count(snapshot::Table::Permanent); ++i) {
+            permanentCount += !isShadowed(mapped->name(snapshot::Table::Permanent, i));
+        }
+    }
+
+    // Same layout as serializing the two maps unsharded.
+    writeTo(sink, temporaryCount);
+    for (const Shard& shard : m_shards) {
+        for (const auto& item : shard.temporary) {
+            writeTo(sink, item.first);
+            writeTo(sink, item.second);
+        }
+    }
+    if (mapped != nullptr) {
+        for (size_t i = 0; i < mapped->count(snapshot::Table::Temporary); ++i) {
+            const std::string_view user = mapped->name(snapshot::Table::Temporary, i);
+            if (!isShadowed(user)) {
+                writeTo(sink, user);
+                writeTo(sink, mapped->value(snapshot::Table::Temporary, i));
+            }
+        }
+    }
+    writeTo(sink, permanentCount);
+    for (const Shard& shard : m_shards) {
+        for (const auto& item : shard.permanent) {
+            writeTo(sink, item.first);
+            writeTo(sink, item.second);
+        }
+    }
+    if (mapped != nullptr) {
+        for (size_t i = 0; i < mapped->count(snapshot::Table::Permanent); ++i) {
+            const std::string_view user = mapped->name(snapshot::Table::Permanent, i);
+            if (!isShadowed(user)) {
+                writeTo(sink, user);
+                writeTo(sink, mapped->value(snapshot::Table::Permanent, i));
+            }
+        }
+    }
+}
+
+bool Engine::readSnapshot(ByteSource& source)
+{
+    // Entries are read into maps per shard, reserved for an even spread, and swapped in only once
+    // the whole stream has parsed, so bad input leaves the state alone and no lock is held while
+    // reading. The old entries are freed with the locals, after the locks are released.
+    std::array<UserToPendingKey, shardCount> temporary;
+    std::array<UserToHash, shardCount> permanent;
+    uint32_t count = 0;
+    if (!readFrom(source, count)) {
+        return false;
+    }
+    for (UserToPendingKey& shard : temporary) {
+        shard.reserve(std::min(count, maxReserve) / shardCount + 1);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        std::pair<std::string, PendingKey> item;
+        if (!readFrom(source, item)) {
+            return false;
+        }
+        temporary[shardIndex(item.first)].insert(std::move(item));
+    }
+
+    if (!readFrom(source, count)) {
+        return false;
+    }
+    for (UserToHash& shard : permanent) {
+        shard.reserve(std::min(count, maxReserve) / shardCount + 1);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        std::pair<std::string, Residue> item;
+        if (!readFrom(source, item)) {
+            return false;
+        }
+        permanent[shardIndex(item.first)].insert(std::move(item));
+    }
+    if (!source.atEnd()) {
         return false;
     }
-    if (m_temporary.find(user) != m_temporary.end()) {
+
+    const auto locks = lockShards();
+    resetState(nullptr);
+    for (size_t s = 0; s < shardCount; ++s) {
+        m_shards[s].temporary.swap(temporary[s]);
+        m_shards[s].permanent.swap(permanent[s]);
+    }
+    return true;
+}
+
+bool Engine::readSnapshot(const Byte* data, size_t size)
+{
+    // All record offsets first, so that malformed data is rejected before the state is touched
+    // and the records can then be decoded in any order.
+    std::vector<size_t> temporary;
+    std::vector<size_t> permanent;
+    size_t position = 0;
+    if (!scanRecords(data, size, position, temporary) || !scanRecords(data, size, position, permanent)
+        || position != size) {
         return false;
     }
-    m_temporary.insert(std::make_pair(user, BigInteger(randomInteger())));
+
+    const auto locks = lockShards();
+    resetState(nullptr);
+    bulkInsert(temporary.size(), [&](size_t i) {
+        return recordName(data + temporary[i]);
+    }, [&](Shard& shard, const std::vector<size_t>& records) {
+        shard.temporary.reserve(records.size());
+        for (size_t i : records) {
+            PendingKey key;
+            key.exponent = recordValue(data + temporary[i]);
+            shard.temporary.emplace(std::string(recordName(data + temporary[i])), key);
+        }
+    });
+    bulkInsert(permanent.size(), [&](size_t i) {
+        return recordName(data + permanent[i]);
+    }, [&](Shard& shard, const std::vector<size_t>& records) {
+        shard.permanent.reserve(records.size());
+        for (size_t i : records) {
+            shard.permanent.emplace(std::string(recordName(data + permanent[i])), recordValue(data + permanent[i]));
+        }
+    });
+    return true;
+}
+
+bool Engine::readSnapshot(const snapshot::View& view)
+{
+    using snapshot::Table;
+    const auto locks = lockShards();
+    resetState(nullptr);
+    bulkInsert(view.count(Table::Temporary), [&](size_t i) {
+        return view.name(Table::Temporary, i);
+    }, [&](Shard& shard, const std::vector<size_t>& records) {
+        shard.temporary.reserve(records.size());
+        for (size_t i : records) {
+            PendingKey key;
+            key.exponent = view.value(Table::Temporary, i);
+            shard.temporary.emplace(std::string(view.name(Table::Temporary, i)), key);
+        }
+    });
+    bulkInsert(view.count(Table::Permanent), [&](size_t i) {
+        return view.name(Table::Permanent, i);
+    }, [&](Shard& shard, const std::vector<size_t>& records) {
+        shard.permanent.reserve(records.size());
+        for (size_t i : records) {
+            shard.permanent.emplace(std::string(view.name(Table::Permanent, i)), view.value(Table::Permanent, i));
+        }
+    });
     return true;
 }
 
-BigInteger Engine::getKeyToSend(const std::string& user) const
+template <typename NameF, typename FillF>
+void Engine::bulkInsert(size_t count, NameF name, FillF fill)
+{
+    // The shards of the records are found in parallel chunks, then one task fills each shard.
+    const size_t chunkSize = 4096;
+    const auto pool = threadPool();
+    std::vector<uint8_t> shardOf(count);
+    pool->parallelFor((count + chunkSize - 1) / chunkSize, [&](size_t chunk) {
+        const size_t end = std::min(count, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; ++i) {
+            shardOf[i] = static_cast<uint8_t>(shardIndex(name(i)));
+        }
+    });
+
+    ShardIndices byShard;
+    std::array<size_t, shardCount> sizes = {};
+    for (const uint8_t shard : shardOf) {
+        ++sizes[shard];
+    }
+    for (size_t s = 0; s < shardCount; ++s) {
+        byShard[s].reserve(sizes[s]);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        byShard[shardOf[i]].push_back(i);
+    }
+    pool->parallelFor(shardCount, [&](size_t s) {
+        fill(m_shards[s], byShard[s]);
+    });
+}
+
+bool Engine::saveSnapshot(const std::string& path) const
+{
+    const auto locks = lockShardsShared();
+    return writeSnapshotFile(path);
+}
+
+bool Engine::writeSnapshotFile(const std::string& path) const
 {
-    auto it = m_temporary.find(user);
-    if (it == m_temporary.end()) {
-        return BigInteger();
+    // Names and values are referenced where they are, in the shards and the mapped file.
+    std::vector<snapshot::Entry> temporary;
+    std::vector<snapshot::Entry> permanent;
+    for (const Shard& shard : m_shards) {
+        for (const auto& item : shard.temporary) {
+            temporary.push_back({item.first, &item.second.exponent, nullptr});
+        }
+        for (const auto& item : shard.permanent) {
+            permanent.push_back({item.first, &item.second, nullptr});
+        }
+    }
+    if (m_mapped) {
+        const snapshot::View& mapped = m_mapped->view();
+        for (size_t i = 0; i < mapped.count(snapshot::Table::Temporary); ++i) {
+            const std::string_view user = mapped.name(snapshot::Table::Temporary, i);
+            if (!isShadowed(user)) {
+                temporary.push_back({user, nullptr, mapped.encodedValue(snapshot::Table::Temporary, i)});
+            }
+        }
+        for (size_t i = 0; i < mapped.count(snapshot::Table::Permanent); ++i) {
+            const std::string_view user = mapped.name(snapshot::Table::Permanent, i);
+            if (!isShadowed(user)) {
+                permanent.push_back({user, nullptr, mapped.encodedValue(snapshot::Table::Permanent, i)});
+            }
+        }
+    }
+
+    // Written next to path and renamed over it, so a crash leaves either file complete.
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        ByteSink sink(stream);
+        snapshot::write(sink, std::move(temporary), std::move(permanent));
+        if (!sink.flush() || !stream.flush()) {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
     }
-    return (m_generator ^ it->second) % m_prime;
+    if (!snapshot::syncFile(temporaryPath)) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    // The rename itself is durable only once the directory is synced, which compact relies on
+    // before emptying the journal.
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0 && snapshot::syncDirectory(path);
 }
 
-void Engine::setReceivedKey(const std::string& user, const BigInteger& key)
+bool Engine::loadSnapshot(const std::string& path, bool verifyChecksum)
 {
-    auto it = m_temporary.find(user);
-    if (it == m_temporary.end()) {
+    auto mapped = snapshot::MappedFile::open(path, verifyChecksum);
+    if (!mapped) {
+        return false;
+    }
+    const auto locks = lockShards();
+    resetState(std::move(mapped));
+    return true;
+}
+
+bool Engine::openJournal(const std::string& path)
+{
+    const auto locks = lockShards();
+    std::shared_ptr<Journal> journal;
+    try {
+        journal = std::make_shared<Journal>(path, [this](const Journal::Record& record) {
+            applyRecord(record);
+        });
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_journalMutex);
+    m_journal.swap(journal);
+    return true;
+}
+
+void Engine::closeJournal()
+{
+    std::shared_ptr<Journal> journal;
+    std::lock_guard<std::mutex> lock(m_journalMutex);
+    m_journal.swap(journal);
+}
+
+bool Engine::compact(const std::string& snapshotPath)
+{
+    // Changes wait for the exclusive lock of their shard, so none can slip in between writing
+    // the snapshot and emptying the journal.
+    const auto locks = lockShardsShared();
+    if (!writeSnapshotFile(snapshotPath)) {
+        return false;
+    }
+    if (const auto journal = this->journal()) {
+        try {
+            journal->clear();
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<Journal> Engine::journal() const
+{
+    std::lock_guard<std::mutex> lock(m_journalMutex);
+    return m_journal;
+}
+
+void Engine::applyRecord(const Journal::Record& record)
+{
+    // Replayed onto a state that may already contain the record, completed pairings stay.
+    Shard& shard = shardFor(record.user);
+    Residue hash;
+    if (findPermanent(shard, record.user, hash)) {
         return;
     }
-    const auto power = it->second;
-    m_temporary.erase(it);
-    m_permanent.insert(std::make_pair(user, (key ^ power) % m_prime));
+    if (record.type == Journal::Type::Prepare) {
+        PendingKey key;
+        key.exponent = record.value;
+        shard.temporary[record.user] = key;
+    } else {
+        eraseUser(shard.temporary, record.user);
+        shard.permanent.insert(std::make_pair(record.user, record.value));
+    }
 }
 
-BigInteger Engine::getHash(const std::string& user) const
+std::vector<std::shared_lock<std::shared_mutex>> Engine::lockShardsShared() const
 {
-    auto it = m_permanent.find(user);
-    if (it == m_permanent.end()) {
-        return BigInteger();
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    for (const Shard& shard : m_shards) {
+        locks.emplace_back(shard.mutex);
     }
-    return it->second;
+    return locks;
 }
 
-ByteArray Engine::serialize() const
+std::vector<std::unique_lock<std::shared_mutex>> Engine::lockShards()
+{
+    // Shards are always locked in index order, so this cannot deadlock.
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (Shard& shard : m_shards) {
+        locks.emplace_back(shard.mutex);
+    }
+    return locks;
+}
+
+void Engine::resetState(std::shared_ptr<const snapshot::MappedFile> mapped)
 {
-    return toByteArray(m_temporary) + toByteArray(m_permanent);
+    for (Shard& shard : m_shards) {
+        shard.temporary.clear();
+        shard.permanent.clear();
+    }
+    m_mapped = std::move(mapped);
+    closeJournal();
 }
 
-bool Engine::deserialize(const ByteArray& data)
+bool Engine::isKnown(const Shard& shard, std::string_view user) const
+{
+    if (containsUser(shard.permanent, user) || containsUser(shard.temporary, user)) {
+        return true;
+    }
+    Residue value;
+    return m_mapped && (m_mapped->view().find(snapshot::Table::Permanent, user, value)
+                        || m_mapped->view().find(snapshot::Table::Temporary, user, value));
+}
+
+bool Engine::findTemporary(const Shard& shard, std::string_view user, PendingKey& key) const
+{
+    auto it = findUser(shard.temporary, user);
+    if (it != shard.temporary.end()) {
+        key = it->second;
+        return true;
+    }
+    if (!m_mapped || containsUser(shard.permanent, user)) {
+        return false;
+    }
+    key.hasPublicKey = false;
+    return m_mapped->view().find(snapshot::Table::Temporary, user, key.exponent);
+}
+
+bool Engine::findPermanent(const Shard& shard, std::string_view user, Residue& hash) const
+{
+    auto it = findUser(shard.permanent, user);
+    if (it != shard.permanent.end()) {
+        hash = it->second;
+        return true;
+    }
+    return m_mapped && m_mapped->view().find(snapshot::Table::Permanent, user, hash);
+}
+
+bool Engine::isShadowed(std::string_view user) const
+{
+    const Shard& shard = shardFor(user);
+    return containsUser(shard.temporary, user) || containsUser(shard.permanent, user);
+}
+
+Engine::PendingKey* Engine::unpackTemporary(const Shard& shard, std::string_view user) const
+{
+    auto it = findUser(shard.temporary, user);
+    if (it != shard.temporary.end()) {
+        return &it->second;
+    }
+    PendingKey key;
+    if (!m_mapped || containsUser(shard.permanent, user)
+        || !m_mapped->view().find(snapshot::Table::Temporary, user, key.exponent)) {
+        return nullptr;
+    }
+    return &shard.temporary.insert(std::make_pair(std::string(user), key)).first->second;
+}
+
+const Engine::Residue* Engine::unpackPermanent(const Shard& shard, std::string_view user) const
+{
+    auto it = findUser(shard.permanent, user);
+    if (it != shard.permanent.end()) {
+        return &it->second;
+    }
+    Residue hash;
+    if (!m_mapped || !m_mapped->view().find(snapshot::Table::Permanent, user, hash)) {
+        return nullptr;
+    }
+    return &shard.permanent.insert(std::make_pair(std::string(user), hash)).first->second;
+}
+
+std::vector<bool> Engine::prepareToPairWithMany(Span<const std::string> users, bool computeKeys)
+{
+    const ShardIndices byShard = groupByShard(users, [](const std::string& user) -> const std::string& { return user; });
+
+    std::vector<char> candidate(users.size(), 0);
+    for (size_t s = 0; s < shardCount; ++s) {
+        std::shared_lock<std::shared_mutex> lock(m_shards[s].mutex);
+        for (size_t i : byShard[s]) {
+            candidate[i] = !isKnown(m_shards[s], users[i]);
+        }
+    }
+
+    const auto pool = keyPool();
+    std::vector<PendingKey> keys(users.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < users.size(); ++i) {
+        if (candidate[i] && !(pool && pool->tryTake(keys[i]))) {
+            keys[i].exponent = Residue(randomInteger());
+            pending.push_back(i);
+        }
+    }
+    if (computeKeys) {
+        threadPool()->parallelFor(pending.size(), [&](size_t j) {
+            PendingKey& key = keys[pending[j]];
+            key.publicKey = powGenerator(key.exponent);
+            key.hasPublicKey = true;
+        });
+    }
+
+    JournalCommits commits;
+    std::vector<bool> result(users.size(), false);
+    try {
+        for (size_t s = 0; s < shardCount; ++s) {
+            std::unique_lock<std::shared_mutex> lock(m_shards[s].mutex);
+            const auto journal = this->journal();
+            for (size_t i : byShard[s]) {
+                if (candidate[i] && !isKnown(m_shards[s], users[i])) {
+                    if (journal) {
+                        noteAppend(commits, journal, journal->append(Journal::Type::Prepare, users[i], keys[i].exponent));
+                    }
+                    result[i] = m_shards[s].temporary.insert(std::make_pair(users[i], keys[i])).second;
+                }
+            }
+        }
+    } catch (...) {
+        // The changes applied before the failure are journaled all the same.
+        commitAll(commits);
+        throw;
+    }
+    commitAll(commits);
+    return result;
+}
+
+std::vector<BigInteger> Engine::getKeysToSend(Span<const std::string> users) const
+{
+    const ShardIndices byShard = groupByShard(users, [](const std::string& user) -> const std::string& { return user; });
+
+    std::vector<Residue> keys(users.size());
+    std::vector<char> found(users.size(), 0);
+    std::vector<size_t> pending;
+    std::vector<Residue> exponents;
+    for (size_t s = 0; s < shardCount; ++s) {
+        std::shared_lock<std::shared_mutex> lock(m_shards[s].mutex);
+        for (size_t i : byShard[s]) {
+            PendingKey key;
+            if (!findTemporary(m_shards[s], users[i], key)) {
+                continue;
+            }
+            found[i] = 1;
+            if (key.hasPublicKey) {
+                keys[i] = key.publicKey;
+            } else {
+                pending.push_back(i);
+                exponents.push_back(key.exponent);
+            }
+        }
+    }
+
+    threadPool()->parallelFor(pending.size(), [&](size_t j) {
+        keys[pending[j]] = powGenerator(exponents[j]);
+    });
+
+    std::vector<size_t> pendingSlot(users.size(), 0);
+    for (size_t j = 0; j < pending.size(); ++j) {
+        pendingSlot[pending[j]] = j + 1;
+    }
+    for (size_t s = 0; s < shardCount; ++s) {
+        std::unique_lock<std::shared_mutex> lock(m_shards[s].mutex);
+        for (size_t i : byShard[s]) {
+            if (pendingSlot[i] == 0) {
+                continue;
+            }
+            PendingKey* key = unpackTemporary(m_shards[s], users[i]);
+            if (key != nullptr && key->exponent == exponents[pendingSlot[i] - 1]) {
+                key->publicKey = keys[i];
+                key->hasPublicKey = true;
+            }
+        }
+    }
+
+    std::vector<BigInteger> result(users.size());
+    for (size_t i = 0; i < users.size(); ++i) {
+        if (found[i]) {
+            result[i] = keys[i].to_big_integer();
+        }
+    }
+    return result;
+}
+
+void Engine::setReceivedKeys(Span<const std::pair<std::string, BigInteger>> keys)
+{
+    using Item = std::pair<std::string, BigInteger>;
+    const ShardIndices byShard = groupByShard(keys, [](const Item& item) -> const std::string& { return item.first; });
+
+    std::vector<Residue> powers(keys.size());
+    std::vector<size_t> pending;
+    for (size_t s = 0; s < shardCount; ++s) {
+        std::shared_lock<std::shared_mutex> lock(m_shards[s].mutex);
+        for (size_t i : byShard[s]) {
+            PendingKey key;
+            if (findTemporary(m_shards[s], keys[i].first, key)) {
+                powers[i] = key.exponent;
+                pending.push_back(i);
+            }
+        }
+    }
+
+    std::vector<Residue> hashes(keys.size());
+    threadPool()->parallelFor(pending.size(), [&](size_t j) {
+        const size_t i = pending[j];
+        hashes[i] = powMod(reduce(keys[i].second), powers[i]);
+    });
+
+    std::vector<char> computed(keys.size(), 0);
+    for (size_t i : pending) {
+        computed[i] = 1;
+    }
+    JournalCommits commits;
+    try {
+        for (size_t s = 0; s < shardCount; ++s) {
+            std::unique_lock<std::shared_mutex> lock(m_shards[s].mutex);
+            const auto journal = this->journal();
+            for (size_t i : byShard[s]) {
+                if (!computed[i]) {
+                    continue;
+                }
+                const PendingKey* key = unpackTemporary(m_shards[s], keys[i].first);
+                if (key == nullptr || key->exponent != powers[i]) {
+                    continue;
+                }
+                if (journal) {
+                    noteAppend(commits, journal, journal->append(Journal::Type::Complete, keys[i].first, hashes[i]));
+                }
+                eraseUser(m_shards[s].temporary, keys[i].first);
+                m_shards[s].permanent.insert(std::make_pair(keys[i].first, hashes[i]));
+            }
+        }
+    } catch (...) {
+        commitAll(commits);
+        throw;
+    }
+    commitAll(commits);
+}
+
+std::future<bool> Engine::prepareToPairWithAsync(std::string_view user, bool computeKey, Executor* executor)
+{
+    return runAsync<bool>(*executorFor(executor), [this, user = std::string(user), computeKey] {
+        return prepareToPairWith(user, computeKey);
+    });
+}
+
+std::future<BigInteger> Engine::getKeyToSendAsync(std::string_view user, Executor* executor) const
+{
+    return runAsync<BigInteger>(*executorFor(executor), [this, user = std::string(user)] {
+        return getKeyToSend(user);
+    });
+}
+
+std::future<void> Engine::setReceivedKeyAsync(std::string_view user, const BigInteger& key, Executor* executor)
+{
+    return runAsync<void>(*executorFor(executor), [this, user = std::string(user), key] {
+        setReceivedKey(user, key);
+    });
+}
+
+#ifdef E2EE_HAS_COROUTINES
+Awaitable<bool> Engine::prepareToPairWithAwaitable(std::string_view user, bool computeKey, Executor* executor)
+{
+    return Awaitable<bool>(executorFor(executor), [this, user = std::string(user), computeKey] {
+        return prepareToPairWith(user, computeKey);
+    });
+}
+
+Awaitable<BigInteger> Engine::getKeyToSendAwaitable(std::string_view user, Executor* executor) const
+{
+    return Awaitable<BigInteger>(executorFor(executor), [this, user = std::string(user)] {
+        return getKeyToSend(user);
+    });
+}
+
+Awaitable<void> Engine::setReceivedKeyAwaitable(std::string_view user, const BigInteger& key, Executor* executor)
+{
+    return Awaitable<void>(executorFor(executor), [this, user = std::string(user), key] {
+        setReceivedKey(user, key);
+    });
+}
+#endif
+
+void Engine::setReduction(Reduction reduction)
+{
+    m_reduction = reduction;
+}
+
+Engine::Reduction Engine::reduction() const
+{
+    return m_reduction;
+}
+
+void Engine::setThreadCount(size_t threadCount)
+{
+    auto pool = std::make_shared<ThreadPool>(threadCount);
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    m_pool.swap(pool);
+}
+
+void Engine::enableKeyPool(size_t lowWater, size_t highWater)
+{
+    auto keyPool = std::make_shared<PrecomputedPool<PendingKey>>(lowWater, highWater, [this] {
+        PendingKey key;
+        key.exponent = Residue(randomInteger());
+        key.publicKey = powGenerator(key.exponent);
+        key.hasPublicKey = true;
+        return key;
+    });
+    std::lock_guard<std::mutex> lock(m_keyPoolMutex);
+    m_keyPool.swap(keyPool);
+}
+
+void Engine::disableKeyPool()
+{
+    std::shared_ptr<PrecomputedPool<PendingKey>> keyPool;
+    {
+        std::lock_guard<std::mutex> lock(m_keyPoolMutex);
+        m_keyPool.swap(keyPool);
+    }
+}
+
+Engine::KeyPoolStats Engine::keyPoolStats() const
+{
+    KeyPoolStats stats;
+    if (const auto pool = keyPool()) {
+        stats.size = pool->size();
+        stats.hits = pool->hits();
+        stats.misses = pool->misses();
+    }
+    return stats;
+}
+
+std::shared_ptr<Executor> Engine::executorFor(Executor* executor) const
+{
+    // A caller's executor is not owned, the Engine's pool is shared so that a concurrent
+    // setThreadCount cannot destroy it mid-call. A replaced pool runs its queued tasks first.
+    if (executor != nullptr) {
+        return std::shared_ptr<Executor>(std::shared_ptr<Executor>(), executor);
+    }
+    return threadPool();
+}
+
+std::shared_ptr<PrecomputedPool<Engine::PendingKey>> Engine::keyPool() const
+{
+    std::lock_guard<std::mutex> lock(m_keyPoolMutex);
+    return m_keyPool;
+}
+
+Engine::PendingKey Engine::makePendingKey(bool computeKey)
+{
+    const auto pool = keyPool();
+    PendingKey key;
+    if (pool && pool->tryTake(key)) {
+        return key;
+    }
+    key.exponent = Residue(randomInteger());
+    if (computeKey) {
+        key.publicKey = powGenerator(key.exponent);
+        key.hasPublicKey = true;
+    }
+    return key;
+}
+
+size_t Engine::shardIndex(std::string_view user) const
+{
+    // Equal to the hash of the same std::string.
+    return std::hash<std::string_view>()(user) % shardCount;
+}
+
+Engine::Shard& Engine::shardFor(std::string_view user)
 {
-    m_temporary.clear();
-    m_permanent.clear();
-    int bytesRead = 0;
-    bytesRead += fromByteArray(&data[bytesRead], m_temporary);
-    bytesRead += fromByteArray(&data[bytesRead], m_permanent);
-    return data.size() == bytesRead;
+    return m_shards[shardIndex(user)];
+}
+
+const Engine::Shard& Engine::shardFor(std::string_view user) const
+{
+    return m_shards[shardIndex(user)];
+}
+
+template <typename ItemT, typename KeyT>
+Engine::ShardIndices Engine::groupByShard(Span<const ItemT> items, KeyT key) const
+{
+    ShardIndices result;
+    for (size_t i = 0; i < items.size(); ++i) {
+        result[shardIndex(key(items[i]))].push_back(i);
+    }
+    return result;
+}
+
+std::shared_ptr<ThreadPool> Engine::threadPool() const
+{
+    // Created on first use so that programs without batch calls start no threads.
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    if (!m_pool) {
+        m_pool = std::make_shared<ThreadPool>();
+    }
+    return m_pool;
 }
 
 int Engine::randomInteger()
 {
+    std::lock_guard<std::mutex> lock(m_randomMutex);
     double r = 0.0;
     while (r <= 0.0 || r >= 256.0) {
         r = m_dis(m_gen);
     }
     return (int)r;
 }
+
+Engine::Residue Engine::reduce(const BigInteger& value) const
+{
+    return m_group->reduce(value);
+}
+
+Engine::Residue Engine::powMod(const Residue& base, const Residue& exponent) const
+{
+    return m_group->powMod(base, exponent, m_reduction);
+}
+
+Engine::Residue Engine::powGenerator(const Residue& exponent) const
+{
+    return m_group->powGenerator(exponent, m_reduction);
+}
@@ -1,37 +1,241 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "Async.h"
 #include "BigInteger.h"
+#include "FlatMap.h"
+#include "GroupParameters.h"
+#include "Journal.h"
 #include "Macros.h"
+#include "PrecomputedPool.h"
+#include "Snapshot.h"
+#include "Span.h"
+#include "ThreadPool.h"
 #include "Utility.h"
 
 namespace E2EE {
 
+// All member functions may be called concurrently. User storage is split into shards by the hash
+// of the user name, each behind its own reader-writer lock, and exponentiations run unlocked.
+// Engines are independent stores; get_instance() returns a process-wide default one.
 class Engine
 {
-    SINGLETON_DECL(Engine)
+    DEFAULT_INSTANCE_DECL(Engine)
 
 public:
-    bool prepareToPairWith(const std::string& user);
-    BigInteger getKeyToSend(const std::string& user) const;
-    void setReceivedKey(const std::string& user, const BigInteger& key);
-    BigInteger getHash(const std::string& user) const;
+    using Reduction = E2EE::Reduction;
+    using Residue = GroupParameters::Residue;
+
+    // Engines built from the same group share its precomputed tables.
+    explicit Engine(std::shared_ptr<const GroupParameters> group = GroupParameters::group15());
+    ~Engine();
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    const std::shared_ptr<const GroupParameters>& group() const;
+
+    // With computeKey the public key is computed right away instead of on the first getKeyToSend.
+    bool prepareToPairWith(std::string_view user, bool computeKey = false);
+    BigInteger getKeyToSend(std::string_view user) const;
+    void setReceivedKey(std::string_view user, const BigInteger& key);
+    BigInteger getHash(std::string_view user) const;
+
+    // Reads that allocate nothing. findHash returns the stored hash or null; it stays valid until
+    // the state is replaced by deserialize or loadSnapshot. The Span overloads write the value as
+    // valueSize little-endian bytes into out and return false, leaving out untouched, if there is
+    // none. Throws std::length_error if out is smaller.
+    static const size_t valueSize = snapshot::valueSize;
+    const Residue* findHash(std::string_view user) const;
+    bool getHash(std::string_view user, Span<Byte> out) const;
+    bool getKeyToSend(std::string_view user, Span<Byte> out) const;
     ByteArray serialize() const;
+    // Also takes version 2 snapshots, see saveSnapshot. Entries are decoded on the thread pool
+    // and malformed data is rejected before the state is touched.
     bool deserialize(const ByteArray& data);
+    // The same snapshot format written to or read from a stream in one buffered pass. deserialize
+    // reads to the end of the stream. Both return false on a stream error or malformed data.
+    bool serialize(std::ostream& stream) const;
+    bool deserialize(std::istream& stream);
+
+    // Version 2 snapshot files, see Snapshot.h. saveSnapshot replaces path atomically.
+    // loadSnapshot maps the file in place of the current state and answers lookups from it,
+    // copying an entry into memory only when it changes. On failure both return false and
+    // loadSnapshot leaves the state unchanged.
+    bool saveSnapshot(const std::string& path) const;
+    bool loadSnapshot(const std::string& path, bool verifyChecksum = true);
+
+    // Write-ahead journal, see Journal.h. openJournal replays path onto the current state, so
+    // recovery is loading the last compacted snapshot and then opening the journal. From then on
+    // every pairing change is journaled and the calls return once it is on disk, throwing
+    // std::runtime_error if it cannot be written. compact saves a snapshot to snapshotPath and
+    // empties the journal. deserialize and loadSnapshot close the journal.
+    bool openJournal(const std::string& path);
+    void closeJournal();
+    bool compact(const std::string& snapshotPath);
+
+    // Batch counterparts of the calls above. The exponentiations of a batch are spread over the
+    // thread pool and the results are stored with one lock per shard. Each result is what the
+    // single-user call would have returned for that element, in order.
+    std::vector<bool> prepareToPairWithMany(Span<const std::string> users, bool computeKeys = false);
+    std::vector<BigInteger> getKeysToSend(Span<const std::string> users) const;
+    void setReceivedKeys(Span<const std::pair<std::string, BigInteger>> keys);
+
+    // Asynchronous counterparts of the calls doing modular exponentiations. They run on executor,
+    // or on the Engine's thread pool if it is null, and the Engine must outlive them.
+    std::future<bool> prepareToPairWithAsync(std::string_view user, bool computeKey = false, Executor* executor = nullptr);
+    std::future<BigInteger> getKeyToSendAsync(std::string_view user, Executor* executor = nullptr) const;
+    std::future<void> setReceivedKeyAsync(std::string_view user, const BigInteger& key, Executor* executor = nullptr);
+#ifdef E2EE_HAS_COROUTINES
+    // The same for co_await, the awaiting coroutine resumes on the executor.
+    Awaitable<bool> prepareToPairWithAwaitable(std::string_view user, bool computeKey = false, Executor* executor = nullptr);
+    Awaitable<BigInteger> getKeyToSendAwaitable(std::string_view user, Executor* executor = nullptr) const;
+    Awaitable<void> setReceivedKeyAwaitable(std::string_view user, const BigInteger& key, Executor* executor = nullptr);
+#endif
+
+    void setReduction(Reduction reduction);
+    Reduction reduction() const;
+
+    // Number of worker threads for batch calls, one per hardware thread unless set.
+    void setThreadCount(size_t threadCount);
+
+    struct KeyPoolStats
+    {
+        size_t   size = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // Starts a background thread that keeps between lowWater and highWater key pairs ready, which
+    // prepareToPairWith takes instead of computing. Replaces the current pool and its counters.
+    void enableKeyPool(size_t lowWater, size_t highWater);
+    void disableKeyPool();
+    KeyPoolStats keyPoolStats() const;
 
 private:
+    // Shard storage: std::unordered_map unless built with E2EE_FLAT_STORAGE, which selects the
+    // open addressing FlatMap with interned names. Both are searched with a std::string_view, the
+    // unordered_map through the transparent UserHash where the library has C++20 heterogeneous
+    // lookup and through a temporary std::string before that.
+    struct UserHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view user) const
+        {
+            return std::hash<std::string_view>()(user);
+        }
+    };
+#ifdef E2EE_FLAT_STORAGE
+    template <typename V>
+    using UserMap = FlatMap<V>;
+#else
+    template <typename V>
+    using UserMap = std::unordered_map<std::string, V, UserHash, std::equal_to<>>;
+#endif
+    using UserToHash = UserMap<Residue>;
+
+    // A handshake in progress: the private exponent and the public key g^exponent mod p,
+    // memoized on first use. Only the exponent is serialized.
+    struct PendingKey
+    {
+        Residue exponent;
+        Residue publicKey;
+        bool    hasPublicKey = false;
+
+        friend void writeTo(ByteSink& sink, const PendingKey& key)
+        {
+            ::writeTo(sink, key.exponent);
+        }
+
+        friend bool readFrom(ByteSource& source, PendingKey& key)
+        {
+            key.hasPublicKey = false;
+            return ::readFrom(source, key.exponent);
+        }
+    };
+    using UserToPendingKey = UserMap<PendingKey>;
+
+    struct Shard
+    {
+        mutable std::shared_mutex mutex;
+        // Mutable for memoizing public keys in getKeyToSend and for copying entries out of the
+        // mapped snapshot in findHash.
+        mutable UserToPendingKey  temporary;
+        mutable UserToHash        permanent;
+    };
+
+    static const size_t shardCount = 16;
+
+    using ShardIndices = std::array<std::vector<size_t>, shardCount>;
+
+    size_t shardIndex(std::string_view user) const;
+    Shard& shardFor(std::string_view user);
+    const Shard& shardFor(std::string_view user) const;
+    template <typename ItemT, typename KeyT>
+    ShardIndices groupByShard(Span<const ItemT> items, KeyT key) const;
+    std::shared_ptr<ThreadPool> threadPool() const;
+    std::shared_ptr<Executor> executorFor(Executor* executor) const;
+    std::shared_ptr<PrecomputedPool<PendingKey>> keyPool() const;
+    PendingKey makePendingKey(bool computeKey);
+    void writeSnapshot(ByteSink& sink) const;
+    bool writeSnapshotFile(const std::string& path) const;
+    bool readSnapshot(ByteSource& source);
+    // Bulk loads: records are decoded on the thread pool straight into reserved shards.
+    bool readSnapshot(const Byte* data, size_t size);
+    bool readSnapshot(const snapshot::View& view);
+    template <typename NameF, typename FillF>
+    void bulkInsert(size_t count, NameF name, FillF fill);
+    std::vector<std::unique_lock<std::shared_mutex>> lockShards();
+    std::vector<std::shared_lock<std::shared_mutex>> lockShardsShared() const;
+    std::shared_ptr<Journal> journal() const;
+    // With every shard locked.
+    void applyRecord(const Journal::Record& record);
+    // With every shard locked, empties the shards and sets the mapped snapshot.
+    void resetState(std::shared_ptr<const snapshot::MappedFile> mapped);
+
+    // Lookups with the user's shard locked. The shard shadows the mapped snapshot: a pending key
+    // completed since loading is in the shard's permanent storage.
+    bool isKnown(const Shard& shard, std::string_view user) const;
+    bool findTemporary(const Shard& shard, std::string_view user, PendingKey& key) const;
+    bool findPermanent(const Shard& shard, std::string_view user, Residue& hash) const;
+    bool isShadowed(std::string_view user) const;
+    // With the shard locked exclusively, the entry of user in the shard, copied there first if
+    // it is only in the mapped snapshot.
+    PendingKey* unpackTemporary(const Shard& shard, std::string_view user) const;
+    const Residue* unpackPermanent(const Shard& shard, std::string_view user) const;
+
     int randomInteger();
+    Residue reduce(const BigInteger& value) const;
+    Residue powMod(const Residue& base, const Residue& exponent) const;
+    Residue powGenerator(const Residue& exponent) const;
 
 private:
-    using UserToHash = std::unordered_map<std::string, BigInteger>;
-
-    UserToHash                              m_temporary;
-    UserToHash                              m_permanent;
-    BigInteger                              m_prime;
-    BigInteger                              m_generator;
+    std::shared_ptr<const GroupParameters>  m_group;
+    std::array<Shard, shardCount>           m_shards;
+    // Replaced only with every shard locked.
+    std::shared_ptr<const snapshot::MappedFile> m_mapped;
+    std::atomic<Reduction>                  m_reduction;
+    mutable std::mutex                      m_poolMutex;
+    mutable std::shared_ptr<ThreadPool>     m_pool;
+    mutable std::mutex                      m_keyPoolMutex;
+    std::shared_ptr<PrecomputedPool<PendingKey>> m_keyPool;
+    mutable std::mutex                      m_journalMutex;
+    std::shared_ptr<Journal>                m_journal;
+    std::mutex                              m_randomMutex;
     std::mt19937                            m_gen;
     std::extreme_value_distribution<double> m_dis;
 };
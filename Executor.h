@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+
+namespace E2EE {
+
+// Something that runs tasks, e.g. a thread pool or an event loop.
+class Executor
+{
+public:
+    virtual ~Executor() = default;
+
+    virtual void execute(std::function<void()> task) = 0;
+};
+
+} // namespace E2EE
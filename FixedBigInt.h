@@ -0,0 +1,298 @@
+#pragma once
+
+#include <array>
+#include <stdexcept>
+
+#include "BigInteger.h"
+#include "Limbs.h"
+
+// Marks helpers that only make sense in constant expressions. Falls back to constexpr before C++20.
+#if defined(__cpp_consteval)
+#define E2EE_CONSTEVAL consteval
+#else
+#define E2EE_CONSTEVAL constexpr
+#endif
+
+// Unsigned integer of a fixed width of Bits bits with inline limb storage. It never allocates,
+// is trivially copyable and its arithmetic is usable in constant expressions. Addition and
+// subtraction wrap modulo 2^Bits like the built-in unsigned types, multiplication widens.
+template <size_t Bits>
+class FixedBigInt
+{
+public:
+    using unit_t = limbs::limb_t;
+
+    static constexpr size_t unit_bits = 64;
+    static constexpr size_t units = (Bits + unit_bits - 1) / unit_bits;
+
+    constexpr FixedBigInt()
+        : m_units{}
+    {}
+
+    constexpr explicit FixedBigInt(const unit_t value)
+        : m_units{}
+    {
+        m_units[0] = value;
+    }
+
+    // Throws std::overflow_error if value is negative or wider than Bits.
+    explicit FixedBigInt(const BigInteger& value)
+        : m_units{}
+    {
+        if (value < 0 || value.bit_length() > Bits) {
+            throw std::overflow_error("Value does not fit in a fixed width integer.");
+        }
+        value.to_units(m_units.data(), units);
+    }
+
+    // Truncates or zero-extends from another width.
+    template <size_t OtherBits>
+    constexpr explicit FixedBigInt(const FixedBigInt<OtherBits>& value)
+        : m_units{}
+    {
+        for (size_t i = 0; i < units && i < FixedBigInt<OtherBits>::units; ++i) {
+            m_units[i] = value[i];
+        }
+        clear_unused_bits();
+    }
+
+    BigInteger to_big_integer() const
+    {
+        return BigInteger::from_units(m_units.data(), units);
+    }
+
+    constexpr unit_t operator[] (const size_t index) const
+    {
+        return m_units[index];
+    }
+
+    constexpr unit_t& operator[] (const size_t index)
+    {
+        return m_units[index];
+    }
+
+    constexpr const unit_t* data() const
+    {
+        return m_units.data();
+    }
+
+    constexpr unit_t* data()
+    {
+        return m_units.data();
+    }
+
+    constexpr bool operator== (const FixedBigInt& rhs) const
+    {
+        return compare(rhs) == 0;
+    }
+
+    constexpr bool operator!= (const FixedBigInt& rhs) const
+    {
+        return compare(rhs) != 0;
+    }
+
+    constexpr bool operator< (const FixedBigInt& rhs) const
+    {
+        return compare(rhs) < 0;
+    }
+
+    constexpr bool operator> (const FixedBigInt& rhs) const
+    {
+        return compare(rhs) > 0;
+    }
+
+    constexpr bool operator<= (const FixedBigInt& rhs) const
+    {
+        return compare(rhs) <= 0;
+    }
+
+    constexpr bool operator>= (const FixedBigInt& rhs) const
+    {
+        return compare(rhs) >= 0;
+    }
+
+    constexpr FixedBigInt operator+ (const FixedBigInt& rhs) const
+    {
+        FixedBigInt result(*this);
+        result += rhs;
+        return result;
+    }
+
+    constexpr FixedBigInt operator- (const FixedBigInt& rhs) const
+    {
+        FixedBigInt result(*this);
+        result -= rhs;
+        return result;
+    }
+
+    // Adds rhs in place and returns the carry out of the top limb.
+    constexpr unit_t add(const FixedBigInt& rhs)
+    {
+        unit_t carry = 0;
+        for (size_t i = 0; i < units; ++i) {
+            m_units[i] = limbs::add_carry(m_units[i], rhs.m_units[i], carry);
+        }
+        return carry;
+    }
+
+    // Subtracts rhs in place and returns the borrow out of the top limb.
+    constexpr unit_t subtract(const FixedBigInt& rhs)
+    {
+        unit_t borrow = 0;
+        for (size_t i = 0; i < units; ++i) {
+            m_units[i] = limbs::sub_borrow(m_units[i], rhs.m_units[i], borrow);
+        }
+        return borrow;
+    }
+
+    constexpr FixedBigInt& operator+= (const FixedBigInt& rhs)
+    {
+        add(rhs);
+        clear_unused_bits();
+        return *this;
+    }
+
+    constexpr FixedBigInt& operator-= (const FixedBigInt& rhs)
+    {
+        subtract(rhs);
+        clear_unused_bits();
+        return *this;
+    }
+
+    template <size_t OtherBits>
+    constexpr FixedBigInt<Bits + OtherBits> operator* (const FixedBigInt<OtherBits>& rhs) const
+    {
+        constexpr size_t rhs_units = FixedBigInt<OtherBits>::units;
+        unit_t product[units + rhs_units] = {};
+        for (size_t j = 0; j < rhs_units; ++j) {
+            unit_t carry = 0;
+            for (size_t i = 0; i < units; ++i) {
+                product[i + j] = limbs::mul_add(m_units[i], rhs[j], product[i + j], carry, carry);
+            }
+            product[units + j] = carry;
+        }
+        FixedBigInt<Bits + OtherBits> result;
+        for (size_t i = 0; i < FixedBigInt<Bits + OtherBits>::units; ++i) {
+            result[i] = product[i];
+        }
+        return result;
+    }
+
+    constexpr FixedBigInt<2 * Bits> square() const
+    {
+        return *this * *this;
+    }
+
+    constexpr FixedBigInt operator<< (const size_t shift) const
+    {
+        FixedBigInt result;
+        const size_t unit_shift = shift / unit_bits;
+        const size_t bit_shift = shift % unit_bits;
+        for (size_t i = units; i > unit_shift; --i) {
+            const size_t source = i - 1 - unit_shift;
+            unit_t value = m_units[source] << bit_shift;
+            if (bit_shift != 0 && source != 0) {
+                value |= m_units[source - 1] >> (unit_bits - bit_shift);
+            }
+            result.m_units[i - 1] = value;
+        }
+        result.clear_unused_bits();
+        return result;
+    }
+
+    constexpr FixedBigInt operator>> (const size_t shift) const
+    {
+        FixedBigInt result;
+        const size_t unit_shift = shift / unit_bits;
+        const size_t bit_shift = shift % unit_bits;
+        for (size_t i = 0; i + unit_shift < units; ++i) {
+            const size_t source = i + unit_shift;
+            unit_t value = m_units[source] >> bit_shift;
+            if (bit_shift != 0 && source + 1 < units) {
+                value |= m_units[source + 1] << (unit_bits - bit_shift);
+            }
+            result.m_units[i] = value;
+        }
+        return result;
+    }
+
+    constexpr size_t bit_length() const
+    {
+        for (size_t i = units; i != 0; --i) {
+            if (m_units[i - 1] != 0) {
+                return i * unit_bits - limbs::count_leading_zeros(m_units[i - 1]);
+            }
+        }
+        return 0;
+    }
+
+    constexpr bool test_bit(const size_t index) const
+    {
+        return index < units * unit_bits && ((m_units[index / unit_bits] >> (index % unit_bits)) & 1);
+    }
+
+    constexpr bool is_zero() const
+    {
+        for (size_t i = 0; i < units; ++i) {
+            if (m_units[i] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    constexpr int compare(const FixedBigInt& rhs) const
+    {
+        for (size_t i = units; i != 0; --i) {
+            if (m_units[i - 1] != rhs.m_units[i - 1]) {
+                return m_units[i - 1] < rhs.m_units[i - 1] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    constexpr void clear_unused_bits()
+    {
+        if (Bits % unit_bits != 0) {
+            m_units[units - 1] &= (unit_t(1) << (Bits % unit_bits)) - 1;
+        }
+    }
+
+private:
+    std::array<unit_t, units> m_units;
+};
+
+// Parses a hexadecimal literal with an optional 0x prefix. Meant for constant initializers,
+// where a bad digit or a too wide value is a compile error.
+template <size_t Bits, size_t N>
+E2EE_CONSTEVAL FixedBigInt<Bits> fixed_from_hex(const char (&text)[N])
+{
+    size_t begin = 0;
+    if (N > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        begin = 2;
+    }
+    FixedBigInt<Bits> result;
+    size_t bit = 0;
+    for (size_t i = N - 1; i > begin; --i) {
+        const char c = text[i - 1];
+        limbs::limb_t digit = 0;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            throw std::invalid_argument("Invalid hexadecimal digit.");
+        }
+        if (digit != 0) {
+            if (bit >= Bits || (bit + 4 > Bits && (digit >> (Bits - bit)) != 0)) {
+                throw std::overflow_error("Value does not fit in a fixed width integer.");
+            }
+            result[bit / 64] |= digit << (bit % 64);
+        }
+        bit += 4;
+    }
+    return result;
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Limbs.h"
+
+namespace E2EE {
+
+// Strings copied into large blocks that never move, so views of them stay valid until clear.
+class NameArena
+{
+public:
+    NameArena()
+        : m_next(nullptr)
+        , m_left(0)
+        , m_used(0)
+    {
+    }
+
+    std::string_view intern(std::string_view name)
+    {
+        if (name.size() > m_left) {
+            const size_t size = std::max(blockSize, name.size());
+            m_blocks.emplace_back(new char[size]);
+            m_next = m_blocks.back().get();
+            m_left = size;
+        }
+        std::memcpy(m_next, name.data(), name.size());
+        const std::string_view result(m_next, name.size());
+        m_next += name.size();
+        m_left -= name.size();
+        m_used += name.size();
+        return result;
+    }
+
+    // Bytes handed out since the last clear.
+    size_t used() const
+    {
+        return m_used;
+    }
+
+    void clear()
+    {
+        m_blocks.clear();
+        m_next = nullptr;
+        m_left = 0;
+        m_used = 0;
+    }
+
+private:
+    static constexpr size_t blockSize = 1 << 16;
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char*                                m_next;
+    size_t                               m_left;
+    size_t                               m_used;
+};
+
+// Hash map from strings to V with the part of the std::unordered_map interface that Engine uses.
+// Entries are stored inline in pages that never move, names are interned in a NameArena and the
+// table is open addressing with linear probing over 8 byte slots, so a lookup reads the slots and
+// a single entry without chasing node pointers. Inserting keeps iterators and references valid.
+// Erasing moves the last entry into the gap, invalidating iterators and references to it.
+template <typename V>
+class FlatMap
+{
+public:
+    struct value_type
+    {
+        std::string_view first;
+        V                second;
+        uint64_t         hash;
+    };
+
+    template <bool Const>
+    class Iterator
+    {
+    public:
+        using Map = typename std::conditional<Const, const FlatMap, FlatMap>::type;
+        using Entry = typename std::conditional<Const, const value_type, value_type>::type;
+
+        Iterator(Map* map, size_t index)
+            : m_map(map)
+            , m_index(index)
+        {
+        }
+
+        operator Iterator<true>() const
+        {
+            return Iterator<true>(m_map, m_index);
+        }
+
+        Entry& operator*() const
+        {
+            return m_map->entry(m_index);
+        }
+
+        Entry* operator->() const
+        {
+            return &m_map->entry(m_index);
+        }
+
+        Iterator& operator++()
+        {
+            ++m_index;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return m_index == other.m_index;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return m_index != other.m_index;
+        }
+
+    private:
+        friend class FlatMap;
+
+        Map*   m_map;
+        size_t m_index;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatMap()
+        : m_size(0)
+        , m_shift(64)
+        , m_garbage(0)
+    {
+    }
+
+    ~FlatMap()
+    {
+        clear();
+    }
+
+    FlatMap(const FlatMap&) = delete;
+    FlatMap& operator=(const FlatMap&) = delete;
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+
+    iterator end()
+    {
+        return iterator(this, m_size);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, m_size);
+    }
+
+    iterator find(std::string_view key)
+    {
+        size_t slot = 0;
+        return locate(key, hashOf(key), slot) ? iterator(this, m_slots[slot].index - 1) : end();
+    }
+
+    const_iterator find(std::string_view key) const
+    {
+        size_t slot = 0;
+        return locate(key, hashOf(key), slot) ? const_iterator(this, m_slots[slot].index - 1) : end();
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(std::string_view key, Args&&... args)
+    {
+        const uint64_t hash = hashOf(key);
+        size_t slot = 0;
+        if (locate(key, hash, slot)) {
+            return std::make_pair(iterator(this, m_slots[slot].index - 1), false);
+        }
+        if ((m_size + 1) * 4 > m_slots.size() * 3) {
+            rehash(std::max<size_t>(16, m_slots.size() * 2));
+            locate(key, hash, slot);
+        }
+        if (m_size == capacity()) {
+            addPage();
+        }
+        new (&entry(m_size)) value_type{m_names.intern(key), V(std::forward<Args>(args)...), hash};
+        m_slots[slot] = Slot{uint32_t(hash), uint32_t(++m_size)};
+        return std::make_pair(iterator(this, m_size - 1), true);
+    }
+
+    template <typename K>
+    std::pair<iterator, bool> insert(const std::pair<K, V>& item)
+    {
+        return emplace(item.first, item.second);
+    }
+
+    V& operator[](std::string_view key)
+    {
+        return emplace(key).first->second;
+    }
+
+    size_t erase(std::string_view key)
+    {
+        const iterator it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    void erase(iterator position)
+    {
+        const size_t index = position.m_index;
+        m_garbage += entry(index).first.size();
+        removeSlot(slotOf(index));
+        const size_t last = m_size - 1;
+        if (index != last) {
+            m_slots[slotOf(last)].index = uint32_t(index + 1);
+            entry(index) = std::move(entry(last));
+        }
+        entry(last).~value_type();
+        --m_size;
+        // Names of erased entries stay in the arena until they outweigh the live ones.
+        if (m_garbage > (1 << 16) && m_garbage * 2 > m_names.used()) {
+            compactNames();
+        }
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < m_size; ++i) {
+            entry(i).~value_type();
+        }
+        for (size_t page = 0; page < m_pages.size(); ++page) {
+            std::allocator<value_type>().deallocate(m_pages[page], pageSize(page));
+        }
+        m_pages.clear();
+        m_slots.clear();
+        m_names.clear();
+        m_size = 0;
+        m_shift = 64;
+        m_garbage = 0;
+    }
+
+    void swap(FlatMap& other) noexcept
+    {
+        std::swap(m_pages, other.m_pages);
+        std::swap(m_size, other.m_size);
+        std::swap(m_slots, other.m_slots);
+        std::swap(m_names, other.m_names);
+        std::swap(m_shift, other.m_shift);
+        std::swap(m_garbage, other.m_garbage);
+    }
+
+    void reserve(size_t count)
+    {
+        while (capacity() < count) {
+            addPage();
+        }
+        size_t slots = 16;
+        while (count * 4 > slots * 3) {
+            slots *= 2;
+        }
+        if (slots > m_slots.size()) {
+            rehash(slots);
+        }
+    }
+
+private:
+    // The low half of the hash, to skip most mismatching entries without reading them, and the
+    // entry index plus one, zero for an empty slot.
+    struct Slot
+    {
+        uint32_t tag;
+        uint32_t index;
+    };
+
+    // Pages double from 16 entries up to 1024, so a small map stays small and a large one grows
+    // without copying. Pages are allocated uninitialized and entries constructed in place.
+    static constexpr size_t firstPageBits = 4;
+    static constexpr size_t lastPageBits = 10;
+    static constexpr size_t growingPages = lastPageBits - firstPageBits + 1;
+    static constexpr size_t growingEntries = ((size_t(1) << growingPages) - 1) << firstPageBits;
+
+    static size_t pageSize(size_t page)
+    {
+        return size_t(1) << (firstPageBits + std::min(page, growingPages - 1));
+    }
+
+    size_t capacity() const
+    {
+        const size_t pages = m_pages.size();
+        if (pages <= growingPages) {
+            return ((size_t(1) << pages) - 1) << firstPageBits;
+        }
+        return growingEntries + (pages - growingPages) * pageSize(growingPages);
+    }
+
+    void addPage()
+    {
+        m_pages.push_back(std::allocator<value_type>().allocate(pageSize(m_pages.size())));
+    }
+
+    value_type& entry(size_t index)
+    {
+        if (index < growingEntries) {
+            const size_t page = 63 - limbs::count_leading_zeros((index >> firstPageBits) + 1);
+            return m_pages[page][index - (((size_t(1) << page) - 1) << firstPageBits)];
+        }
+        index -= growingEntries;
+        const size_t size = pageSize(growingPages);
+        return m_pages[growingPages + index / size][index % size];
+    }
+
+    const value_type& entry(size_t index) const
+    {
+        return const_cast<FlatMap*>(this)->entry(index);
+    }
+
+    static uint64_t hashOf(std::string_view key)
+    {
+        return std::hash<std::string_view>()(key);
+    }
+
+    // Fibonacci hashing, so that keys sharing low hash bits, like all keys of one Engine shard,
+    // still spread over the table.
+    size_t home(uint64_t hash) const
+    {
+        return size_t((hash * 0x9e3779b97f4a7c15ull) >> m_shift);
+    }
+
+    size_t mask() const
+    {
+        return m_slots.size() - 1;
+    }
+
+    // The slot of key if present, otherwise the empty slot where it would go.
+    bool locate(std::string_view key, uint64_t hash, size_t& slot) const
+    {
+        if (m_slots.empty()) {
+            return false;
+        }
+        for (slot = home(hash); m_slots[slot].index != 0; slot = (slot + 1) & mask()) {
+            if (m_slots[slot].tag == uint32_t(hash)) {
+                const value_type& candidate = entry(m_slots[slot].index - 1);
+                if (candidate.hash == hash && candidate.first == key) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t slotOf(size_t index) const
+    {
+        size_t slot = home(entry(index).hash);
+        while (m_slots[slot].index != index + 1) {
+            slot = (slot + 1) & mask();
+        }
+        return slot;
+    }
+
+    // Backward shift deletion: later slots of the probe run move up, so no tombstones are needed.
+    void removeSlot(size_t hole)
+    {
+        for (size_t next = (hole + 1) & mask(); m_slots[next].index != 0; next = (next + 1) & mask()) {
+            const size_t wanted = home(entry(m_slots[next].index - 1).hash);
+            if (((next - wanted) & mask()) >= ((next - hole) & mask())) {
+                m_slots[hole] = m_slots[next];
+                hole = next;
+            }
+        }
+        m_slots[hole] = Slot{0, 0};
+    }
+
+    void rehash(size_t slots)
+    {
+        m_slots.assign(slots, Slot{0, 0});
+        m_shift = 64;
+        for (size_t size = slots; size > 1; size >>= 1) {
+            --m_shift;
+        }
+        for (size_t i = 0; i < m_size; ++i) {
+            const uint64_t hash = entry(i).hash;
+            size_t slot = home(hash);
+            while (m_slots[slot].index != 0) {
+                slot = (slot + 1) & mask();
+            }
+            m_slots[slot] = Slot{uint32_t(hash), uint32_t(i + 1)};
+        }
+    }
+
+    void compactNames()
+    {
+        NameArena names;
+        for (size_t i = 0; i < m_size; ++i) {
+            entry(i).first = names.intern(entry(i).first);
+        }
+        std::swap(m_names, names);
+        m_garbage = 0;
+    }
+
+private:
+    std::vector<value_type*> m_pages;
+    size_t                   m_size;
+    std::vector<Slot>        m_slots;
+    NameArena                m_names;
+    unsigned                 m_shift;
+    size_t                   m_garbage;
+};
+
+} // namespace E2EE
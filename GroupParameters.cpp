@@ -0,0 +1,102 @@
+#include "GroupParameters.h"
+
+using namespace E2EE;
+
+namespace {
+
+// Powers of two come from the shift path while the exponent is short enough that the comb
+// would do as many squarings, everything else from the comb table.
+template <typename ContextT, typename IntegerT>
+void generatorPowMod(const ContextT& context, std::unique_ptr<FixedBaseComb<ContextT>>& comb, std::once_flag& combOnce,
+                     const IntegerT& generator, IntegerT& result, const IntegerT& exponent)
+{
+    if (generator == IntegerT(2) && exponent.bit_length() <= FixedBaseComb<ContextT>::span(context)) {
+        two_pow_mod(context, result.data(), exponent);
+        context.from_residue(result.data(), result.data());
+        return;
+    }
+    std::call_once(combOnce, [&] {
+        comb = std::make_unique<FixedBaseComb<ContextT>>(context, generator.data());
+    });
+    comb->pow_mod(result.data(), exponent);
+}
+
+} // namespace
+
+GroupParameters::GroupParameters()
+    : m_prime(modp::group15_prime)
+    , m_generator(modp::group15_generator)
+    , m_montgomery(modp::group15_prime.data(), modp::group15_units, modp::group15_montgomery_inverse,
+                   modp::group15_montgomery_r_squared.data(), modp::group15_montgomery_one.data())
+    , m_barrett(modp::group15_prime.data(), modp::group15_units, modp::group15_barrett_mu.data())
+    , m_specialForm(modp::group15_prime.data(), modp::group15_units)
+{
+}
+
+std::shared_ptr<const GroupParameters> GroupParameters::group15()
+{
+    static const std::shared_ptr<const GroupParameters> instance = std::make_shared<GroupParameters>();
+    return instance;
+}
+
+const GroupParameters::Residue& GroupParameters::prime() const
+{
+    return m_prime;
+}
+
+const GroupParameters::Residue& GroupParameters::generator() const
+{
+    return m_generator;
+}
+
+GroupParameters::Residue GroupParameters::reduce(const BigInteger& value) const
+{
+    if (value >= 0 && value.bit_length() <= modp::group15_bits) {
+        // p exceeds 2^3071, so one subtraction brings anything below 2^3072 under p.
+        Residue residue(value);
+        if (residue >= m_prime) {
+            residue -= m_prime;
+        }
+        return residue;
+    }
+    const BigInteger prime = m_prime.to_big_integer();
+    BigInteger reduced = value % prime;
+    if (reduced < 0) {
+        reduced += prime;
+    }
+    return Residue(reduced);
+}
+
+GroupParameters::Residue GroupParameters::powMod(const Residue& base, const Residue& exponent, Reduction reduction) const
+{
+    Residue result;
+    switch (reduction) {
+    case Reduction::Barrett:
+        m_barrett.pow_mod(result.data(), base.data(), exponent);
+        break;
+    case Reduction::SpecialForm:
+        m_specialForm.pow_mod(result.data(), base.data(), exponent);
+        break;
+    default:
+        m_montgomery.pow_mod(result.data(), base.data(), exponent);
+        break;
+    }
+    return result;
+}
+
+GroupParameters::Residue GroupParameters::powGenerator(const Residue& exponent, Reduction reduction) const
+{
+    Residue result;
+    switch (reduction) {
+    case Reduction::Barrett:
+        generatorPowMod(m_barrett, m_barrettComb, m_barrettCombOnce, m_generator, result, exponent);
+        break;
+    case Reduction::SpecialForm:
+        generatorPowMod(m_specialForm, m_specialFormComb, m_specialFormCombOnce, m_generator, result, exponent);
+        break;
+    default:
+        generatorPowMod(m_montgomery, m_montgomeryComb, m_montgomeryCombOnce, m_generator, result, exponent);
+        break;
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include "BarrettContext.h"
+#include "BigInteger.h"
+#include "FixedBigInt.h"
+#include "ModpGroup.h"
+#include "MontgomeryContext.h"
+#include "SpecialFormContext.h"
+
+namespace E2EE {
+
+// How products are reduced modulo the prime during exponentiation.
+enum class Reduction
+{
+    Montgomery,
+    Barrett,
+    SpecialForm
+};
+
+// The Diffie-Hellman group: prime, generator, the reduction contexts and the fixed-base tables
+// for the generator. Immutable apart from the tables, which are built once on first use, so one
+// instance can be shared by any number of engines and threads.
+class GroupParameters
+{
+public:
+    // Wide enough for any value modulo the prime.
+    using Residue = modp::Group15Int;
+
+    // RFC 3526 group 15 with generator 2, from the constants of ModpGroup.h.
+    GroupParameters();
+
+    GroupParameters(const GroupParameters&) = delete;
+    GroupParameters& operator=(const GroupParameters&) = delete;
+
+    // The process-wide group 15 instance that engines use by default.
+    static std::shared_ptr<const GroupParameters> group15();
+
+    const Residue& prime() const;
+    const Residue& generator() const;
+
+    // value mod p, always below p.
+    Residue reduce(const BigInteger& value) const;
+    Residue powMod(const Residue& base, const Residue& exponent, Reduction reduction) const;
+    Residue powGenerator(const Residue& exponent, Reduction reduction) const;
+
+private:
+    Residue            m_prime;
+    Residue            m_generator;
+    MontgomeryContext  m_montgomery;
+    BarrettContext     m_barrett;
+    SpecialFormContext m_specialForm;
+    // Fixed-base tables for the generator, built on first use by each reducer.
+    mutable std::unique_ptr<FixedBaseComb<MontgomeryContext>>  m_montgomeryComb;
+    mutable std::unique_ptr<FixedBaseComb<BarrettContext>>     m_barrettComb;
+    mutable std::unique_ptr<FixedBaseComb<SpecialFormContext>> m_specialFormComb;
+    mutable std::once_flag                                     m_montgomeryCombOnce;
+    mutable std::once_flag                                     m_barrettCombOnce;
+    mutable std::once_flag                                     m_specialFormCombOnce;
+};
+
+} // namespace E2EE
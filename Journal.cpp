@@ -0,0 +1,207 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Journal.h"
+
+using namespace E2EE;
+
+namespace {
+
+const Byte magic[8] = {'E', '2', 'E', 'E', 'J', 'R', 'N', 'L'};
+const uint32_t version = 1;
+const size_t headerSize = 16;
+
+std::runtime_error failure(const std::string& what, const std::string& path)
+{
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+Journal::Journal(const std::string& path, const std::function<void(const Record&)>& replay)
+    : m_path(path)
+    , m_descriptor(-1)
+    , m_appended(0)
+    , m_durable(0)
+    , m_flushing(false)
+    , m_failed(false)
+{
+    m_descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (m_descriptor < 0) {
+        throw failure("Cannot open journal", path);
+    }
+    uint64_t end = 0;
+    if (!readRecords(replay, end)) {
+        ::close(m_descriptor);
+        throw std::runtime_error("Not a journal: " + path);
+    }
+    if (::ftruncate(m_descriptor, end) != 0) {
+        ::close(m_descriptor);
+        throw failure("Cannot truncate journal", path);
+    }
+    if (end == 0) {
+        Byte header[headerSize] = {};
+        std::memcpy(header, magic, sizeof(magic));
+        snapshot::storeLittle(header + 8, version, 4);
+        snapshot::storeLittle(header + 12, snapshot::valueSize, 4);
+        m_buffer.assign(header, headerSize);
+    }
+    m_appended = 1;
+    try {
+        commit(m_appended);
+    } catch (...) {
+        ::close(m_descriptor);
+        throw;
+    }
+    // A new journal could otherwise vanish with its directory entry, records and all.
+    if (end == 0 && !snapshot::syncDirectory(path)) {
+        const std::runtime_error error = failure("Cannot sync the directory of journal", path);
+        ::close(m_descriptor);
+        throw error;
+    }
+}
+
+Journal::~Journal()
+{
+    // Records appended but never committed are lost, like after a crash.
+    ::close(m_descriptor);
+}
+
+uint64_t Journal::append(Type type, std::string_view user, const Residue& value)
+{
+    if (user.size() > maxNameLength) {
+        throw std::length_error("User name too long for a journal.");
+    }
+    Byte head[5];
+    head[0] = Byte(type);
+    snapshot::storeLittle(head + 1, user.size(), 4);
+    Byte encoded[snapshot::valueSize];
+    for (size_t i = 0; i < Residue::units; ++i) {
+        snapshot::storeLittle(encoded + 8 * i, value[i], 8);
+    }
+    snapshot::Checksum checksum;
+    checksum.update(head, sizeof(head));
+    checksum.update(reinterpret_cast<const Byte*>(user.data()), user.size());
+    checksum.update(encoded, sizeof(encoded));
+    Byte tail[8];
+    snapshot::storeLittle(tail, checksum.value(), 8);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.append(head, sizeof(head));
+    m_buffer.append(reinterpret_cast<const Byte*>(user.data()), user.size());
+    m_buffer.append(encoded, sizeof(encoded));
+    m_buffer.append(tail, sizeof(tail));
+    return ++m_appended;
+}
+
+void Journal::commit(uint64_t sequence)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_durable < sequence) {
+        if (m_failed) {
+            throw std::runtime_error("Journal " + m_path + " failed, records may be missing.");
+        }
+        if (m_flushing) {
+            m_flushed.wait(lock);
+            continue;
+        }
+        // This thread writes out the whole buffer on behalf of every waiting committer.
+        m_flushing = true;
+        ByteArray batch;
+        batch.swap(m_buffer);
+        const uint64_t last = m_appended;
+        lock.unlock();
+        const bool synced = writeAll(batch) && ::fdatasync(m_descriptor) == 0;
+        lock.lock();
+        m_flushing = false;
+        m_flushed.notify_all();
+        if (!synced) {
+            // The batch is gone, so no later commit may claim success either.
+            m_failed = true;
+            throw failure("Cannot write journal", m_path);
+        }
+        m_durable = last;
+    }
+}
+
+void Journal::clear()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flushed.wait(lock, [this] { return !m_flushing; });
+    if (::ftruncate(m_descriptor, headerSize) != 0 || ::fdatasync(m_descriptor) != 0) {
+        throw failure("Cannot truncate journal", m_path);
+    }
+    m_buffer.clear();
+    m_durable = m_appended;
+    m_failed = false;
+}
+
+bool Journal::readRecords(const std::function<void(const Record&)>& replay, uint64_t& end)
+{
+    std::ifstream stream(m_path, std::ios::binary);
+    ByteSource source(stream);
+    Byte header[headerSize];
+    if (!source.read(header, headerSize)) {
+        // Empty or torn while being created.
+        end = 0;
+        return true;
+    }
+    if (std::memcmp(header, magic, sizeof(magic)) != 0 || snapshot::loadLittle(header + 8, 4) != version
+        || snapshot::loadLittle(header + 12, 4) != snapshot::valueSize) {
+        return false;
+    }
+
+    end = headerSize;
+    Record record;
+    std::string name;
+    Byte head[5];
+    Byte encoded[snapshot::valueSize];
+    Byte tail[8];
+    while (source.read(head, sizeof(head))) {
+        const uint32_t nameLength = uint32_t(snapshot::loadLittle(head + 1, 4));
+        if ((head[0] != Byte(Type::Prepare) && head[0] != Byte(Type::Complete)) || nameLength > maxNameLength) {
+            break;
+        }
+        name.resize(nameLength);
+        if (!source.read(reinterpret_cast<Byte*>(&name[0]), nameLength) || !source.read(encoded, sizeof(encoded))
+            || !source.read(tail, sizeof(tail))) {
+            break;
+        }
+        snapshot::Checksum checksum;
+        checksum.update(head, sizeof(head));
+        checksum.update(reinterpret_cast<const Byte*>(name.data()), name.size());
+        checksum.update(encoded, sizeof(encoded));
+        if (checksum.value() != snapshot::loadLittle(tail, 8)) {
+            break;
+        }
+        record.type = Type(head[0]);
+        record.user.swap(name);
+        for (size_t i = 0; i < Residue::units; ++i) {
+            record.value[i] = snapshot::loadLittle(encoded + 8 * i, 8);
+        }
+        replay(record);
+        end += sizeof(head) + nameLength + sizeof(encoded) + sizeof(tail);
+    }
+    return true;
+}
+
+bool Journal::writeAll(const ByteArray& data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = ::write(m_descriptor, data.data() + written, data.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        written += size_t(result);
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "Snapshot.h"
+
+namespace E2EE {
+
+// Append-only write-ahead log of Engine mutations. The file is a 16 byte header, "E2EEJRNL",
+// u32 version and u32 value width, followed by records of u8 type, u32 name length, the name,
+// the value as in snapshot records and a u64 checksum of the record. Appends are buffered and
+// commit writes and syncs everything buffered at once, so concurrent committers share an fsync.
+class Journal
+{
+public:
+    using Residue = snapshot::Residue;
+
+    enum class Type : uint8_t
+    {
+        // A pending key: the user and the private exponent.
+        Prepare = 1,
+        // A completed pairing: the user and the shared hash.
+        Complete = 2
+    };
+
+    struct Record
+    {
+        Type        type;
+        std::string user;
+        Residue     value;
+    };
+
+    // Opens path, creating it if missing, and passes each intact record to replay in order.
+    // A record torn by a crash ends the journal and is cut off. Throws std::runtime_error if
+    // the file cannot be used.
+    Journal(const std::string& path, const std::function<void(const Record&)>& replay);
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Longest user name a record can hold. Replay takes a longer length for a torn record.
+    static const uint32_t maxNameLength = 1u << 20;
+
+    // Buffers a record and returns its sequence number for commit. Throws std::length_error,
+    // buffering nothing, if user is longer than maxNameLength.
+    uint64_t append(Type type, std::string_view user, const Residue& value);
+    // Returns once every record up to sequence is on disk. Throws std::runtime_error on a
+    // write or sync failure, and from then on until clear.
+    void commit(uint64_t sequence);
+    // Drops every record, once they are all in a snapshot.
+    void clear();
+
+private:
+    bool readRecords(const std::function<void(const Record&)>& replay, uint64_t& end);
+    bool writeAll(const ByteArray& data);
+
+private:
+    std::string             m_path;
+    int                     m_descriptor;
+    std::mutex              m_mutex;
+    std::condition_variable m_flushed;
+    ByteArray               m_buffer;
+    uint64_t                m_appended;
+    uint64_t                m_durable;
+    bool                    m_flushing;
+    bool                    m_failed;
+};
+
+} // namespace E2EE
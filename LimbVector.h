@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "Limbs.h"
+
+// Limb storage of BigInteger: the part of the std::vector interface it uses, keeping up to
+// inline_capacity limbs inside the object so that small values never touch the heap. Grown
+// storage is kept on shrinking, like std::vector's.
+class LimbVector
+{
+public:
+    using value_type = limbs::limb_t;
+    using iterator = value_type*;
+    using const_iterator = const value_type*;
+
+    static const size_t inline_capacity = 4;
+
+    LimbVector() noexcept
+        : m_data(m_inline)
+        , m_size(0)
+        , m_capacity(inline_capacity)
+    {}
+
+    LimbVector(const LimbVector& that)
+        : LimbVector()
+    {
+        assign(that.begin(), that.end());
+    }
+
+    LimbVector(LimbVector&& that) noexcept
+        : LimbVector()
+    {
+        steal(that);
+    }
+
+    LimbVector& operator= (const LimbVector& that)
+    {
+        if (this != &that) {
+            assign(that.begin(), that.end());
+        }
+        return *this;
+    }
+
+    LimbVector& operator= (LimbVector&& that) noexcept
+    {
+        if (this != &that) {
+            release();
+            steal(that);
+        }
+        return *this;
+    }
+
+    ~LimbVector()
+    {
+        release();
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    value_type* data()
+    {
+        return m_data;
+    }
+
+    const value_type* data() const
+    {
+        return m_data;
+    }
+
+    value_type& operator[] (const size_t index)
+    {
+        return m_data[index];
+    }
+
+    const value_type& operator[] (const size_t index) const
+    {
+        return m_data[index];
+    }
+
+    iterator begin()
+    {
+        return m_data;
+    }
+
+    iterator end()
+    {
+        return m_data + m_size;
+    }
+
+    const_iterator begin() const
+    {
+        return m_data;
+    }
+
+    const_iterator end() const
+    {
+        return m_data + m_size;
+    }
+
+    void reserve(const size_t capacity)
+    {
+        if (capacity > m_capacity) {
+            reallocate(capacity);
+        }
+    }
+
+    // New limbs are zero.
+    void resize(const size_t size)
+    {
+        if (size > m_capacity) {
+            reallocate(std::max(size, 2 * m_capacity));
+        }
+        if (size > m_size) {
+            std::fill(m_data + m_size, m_data + size, 0);
+        }
+        m_size = size;
+    }
+
+    void clear()
+    {
+        m_size = 0;
+    }
+
+    void assign(const size_t size, const value_type value)
+    {
+        m_size = 0;
+        reserve(size);
+        std::fill(m_data, m_data + size, value);
+        m_size = size;
+    }
+
+    // The range must not lie in this vector.
+    void assign(const value_type* first, const value_type* last)
+    {
+        const size_t size = last - first;
+        m_size = 0;
+        reserve(size);
+        std::copy(first, last, m_data);
+        m_size = size;
+    }
+
+    bool operator== (const LimbVector& rhs) const
+    {
+        return m_size == rhs.m_size && std::equal(begin(), end(), rhs.begin());
+    }
+
+    bool operator!= (const LimbVector& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    void reallocate(const size_t capacity)
+    {
+        value_type* data = new value_type[capacity];
+        std::copy(m_data, m_data + m_size, data);
+        release();
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    void release()
+    {
+        if (m_data != m_inline) {
+            delete[] m_data;
+            m_data = m_inline;
+            m_capacity = inline_capacity;
+        }
+    }
+
+    // Takes the heap storage of that, or copies its inline limbs, and leaves that empty.
+    void steal(LimbVector& that)
+    {
+        if (that.m_data == that.m_inline) {
+            std::copy(that.m_inline, that.m_inline + that.m_size, m_inline);
+        } else {
+            m_data = that.m_data;
+            m_capacity = that.m_capacity;
+            that.m_data = that.m_inline;
+            that.m_capacity = inline_capacity;
+        }
+        m_size = that.m_size;
+        that.m_size = 0;
+    }
+
+private:
+    value_type* m_data;
+    size_t      m_size;
+    size_t      m_capacity;
+    value_type  m_inline[inline_capacity];
+};
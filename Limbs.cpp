@@ -0,0 +1,649 @@
+#include <algorithm>
+
+#include "Limbs.h"
+#include "Scratch.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define E2EE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace limbs {
+
+namespace {
+
+bool eq_n_scalar(const limb_t* a, const limb_t* b, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int cmp_n_scalar(const limb_t* a, const limb_t* b, const size_t n)
+{
+    size_t i = n;
+    while (i != 0) {
+        --i;
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+void select_n_scalar(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, const bool condition)
+{
+    const limb_t mask = 0 - limb_t(condition);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = (a[i] & mask) | (b[i] & ~mask);
+    }
+}
+
+#ifdef E2EE_X86_KERNELS
+
+// The AVX2 kernels work on four limbs at a time and leave the last n % 4 to the scalar ones.
+// They are compiled for AVX2 regardless of the build flags and only called when the CPU has it.
+#define E2EE_AVX2 __attribute__((target("avx2")))
+
+E2EE_AVX2 __m256i load4(const limb_t* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+E2EE_AVX2 void store4(limb_t* p, const __m256i value)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), value);
+}
+
+E2EE_AVX2 bool eq_n_avx2(const limb_t* a, const limb_t* b, const size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256i difference = _mm256_xor_si256(load4(a + i), load4(b + i));
+        if (!_mm256_testz_si256(difference, difference)) {
+            return false;
+        }
+    }
+    return eq_n_scalar(a + i, b + i, n - i);
+}
+
+// Walks down from the top, the n % 4 limbs above the last full block of four first.
+E2EE_AVX2 int cmp_n_avx2(const limb_t* a, const limb_t* b, const size_t n)
+{
+    const size_t blocks = n & ~size_t(3);
+    const int top = cmp_n_scalar(a + blocks, b + blocks, n - blocks);
+    if (top != 0) {
+        return top;
+    }
+    for (size_t i = blocks; i != 0; ) {
+        i -= 4;
+        const __m256i equal = _mm256_cmpeq_epi64(load4(a + i), load4(b + i));
+        const unsigned differing = ~unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(equal))) & 0xf;
+        if (differing != 0) {
+            const size_t index = i + 31 - __builtin_clz(differing);
+            return a[index] < b[index] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+E2EE_AVX2 void select_n_avx2(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, const bool condition)
+{
+    const __m256i mask = _mm256_set1_epi64x(-(long long)condition);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        store4(r + i, _mm256_or_si256(_mm256_and_si256(load4(a + i), mask), _mm256_andnot_si256(mask, load4(b + i))));
+    }
+    select_n_scalar(r + i, a + i, b + i, n - i, condition);
+}
+
+#undef E2EE_AVX2
+
+#endif
+
+// The kernels picked for the CPU on first use.
+struct Kernels
+{
+    bool (*eq_n)(const limb_t*, const limb_t*, size_t);
+    int  (*cmp_n)(const limb_t*, const limb_t*, size_t);
+    void (*select_n)(limb_t*, const limb_t*, const limb_t*, size_t, bool);
+};
+
+Kernels detect_kernels()
+{
+#ifdef E2EE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernels{eq_n_avx2, cmp_n_avx2, select_n_avx2};
+    }
+#endif
+    return Kernels{eq_n_scalar, cmp_n_scalar, select_n_scalar};
+}
+
+const Kernels& kernels()
+{
+    static const Kernels instance = detect_kernels();
+    return instance;
+}
+
+} // namespace
+
+// On x86-64 the carry chains are written with the add-with-carry intrinsics, which compile to
+// a single adc or sbb per limb where the portable form needs compares to recover the carry.
+limb_t add_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n)
+{
+#ifdef E2EE_X86_KERNELS
+    unsigned long long* out = reinterpret_cast<unsigned long long*>(r);
+    unsigned char carry = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        carry = _addcarry_u64(carry, a[i], b[i], out + i);
+        carry = _addcarry_u64(carry, a[i + 1], b[i + 1], out + i + 1);
+        carry = _addcarry_u64(carry, a[i + 2], b[i + 2], out + i + 2);
+        carry = _addcarry_u64(carry, a[i + 3], b[i + 3], out + i + 3);
+    }
+    for (; i < n; ++i) {
+        carry = _addcarry_u64(carry, a[i], b[i], out + i);
+    }
+    return carry;
+#else
+    limb_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = add_carry(a[i], b[i], carry);
+    }
+    return carry;
+#endif
+}
+
+limb_t sub_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n)
+{
+#ifdef E2EE_X86_KERNELS
+    unsigned long long* out = reinterpret_cast<unsigned long long*>(r);
+    unsigned char borrow = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        borrow = _subborrow_u64(borrow, a[i], b[i], out + i);
+        borrow = _subborrow_u64(borrow, a[i + 1], b[i + 1], out + i + 1);
+        borrow = _subborrow_u64(borrow, a[i + 2], b[i + 2], out + i + 2);
+        borrow = _subborrow_u64(borrow, a[i + 3], b[i + 3], out + i + 3);
+    }
+    for (; i < n; ++i) {
+        borrow = _subborrow_u64(borrow, a[i], b[i], out + i);
+    }
+    return borrow;
+#else
+    limb_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = sub_borrow(a[i], b[i], borrow);
+    }
+    return borrow;
+#endif
+}
+
+int cmp_n(const limb_t* a, const limb_t* b, const size_t n)
+{
+    return kernels().cmp_n(a, b, n);
+}
+
+bool eq_n(const limb_t* a, const limb_t* b, const size_t n)
+{
+    return kernels().eq_n(a, b, n);
+}
+
+void select_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, const bool condition)
+{
+    kernels().select_n(r, a, b, n, condition);
+}
+
+void add_mod_n(limb_t* r, const limb_t* a, const limb_t* b, const limb_t* p, const size_t n)
+{
+    // The sum minus p unless the subtraction borrows past the carry out of the sum.
+    limb_t sum[add_mod_max];
+    limb_t difference[add_mod_max];
+    const limb_t carry = add_n(sum, a, b, n);
+    const limb_t borrow = sub_n(difference, sum, p, n);
+    select_n(r, sum, difference, n, carry < borrow);
+}
+
+limb_t mul_1(limb_t* r, const limb_t* a, const size_t n, const limb_t b)
+{
+    limb_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = mul_add(a[i], b, carry, 0, carry);
+    }
+    return carry;
+}
+
+limb_t addmul_1(limb_t* r, const limb_t* a, const size_t n, const limb_t b)
+{
+    limb_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = mul_add(a[i], b, r[i], carry, carry);
+    }
+    return carry;
+}
+
+limb_t submul_1(limb_t* r, const limb_t* a, const size_t n, const limb_t b)
+{
+    limb_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        limb_t hi = 0;
+        const limb_t lo = mul_add(a[i], b, borrow, 0, hi);
+        borrow = hi + (r[i] < lo);
+        r[i] -= lo;
+    }
+    return borrow;
+}
+
+void mul_basecase(limb_t* r, const limb_t* a, const size_t an, const limb_t* b, const size_t bn)
+{
+    r[an] = mul_1(r, a, an, b[0]);
+    for (size_t i = 1; i < bn; ++i) {
+        r[an + i] = addmul_1(r + i, a, an, b[i]);
+    }
+}
+
+void sqr_basecase(limb_t* r, const limb_t* a, const size_t n)
+{
+    // Off-diagonal products a[i] * a[j], i < j, are computed once and doubled.
+    for (size_t i = 0; i < 2 * n; ++i) {
+        r[i] = 0;
+    }
+    for (size_t i = 0; i + 1 < n; ++i) {
+        r[2 * i + n - i] = addmul_1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+    limb_t carry = 0;
+    for (size_t i = 0; i < 2 * n; ++i) {
+        const limb_t doubled = (r[i] << 1) | carry;
+        carry = r[i] >> 63;
+        r[i] = doubled;
+    }
+    carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        limb_t hi = 0;
+        const limb_t lo = mul_wide(a[i], a[i], hi);
+        r[2 * i] = add_carry(r[2 * i], lo, carry);
+        r[2 * i + 1] = add_carry(r[2 * i + 1], hi, carry);
+    }
+}
+
+namespace {
+
+// Adds x[0, xn) into r[offset, rn) and propagates the carry. Limbs beyond rn are dropped,
+// so callers only use it where the exact sum fits.
+void add_at(limb_t* r, const size_t rn, const size_t offset, const limb_t* x, const size_t xn)
+{
+    limb_t carry = 0;
+    size_t i = offset;
+    for (size_t j = 0; j < xn && i < rn; ++i, ++j) {
+        r[i] = add_carry(r[i], x[j], carry);
+    }
+    for (; carry != 0 && i < rn; ++i) {
+        r[i] = add_carry(r[i], 0, carry);
+    }
+}
+
+// r[0, rn) -= x[0, xn) for xn <= rn, wrapping around as a two's complement number.
+void sub_from(limb_t* r, const size_t rn, const limb_t* x, const size_t xn)
+{
+    limb_t borrow = sub_n(r, r, x, xn);
+    for (size_t i = xn; i < rn; ++i) {
+        r[i] = sub_borrow(r[i], 0, borrow);
+    }
+}
+
+// r[0, xn) = |x - y| for yn <= xn <= yn + 1, returns true if x < y. r may alias x.
+bool abs_diff(limb_t* r, const limb_t* x, const size_t xn, const limb_t* y, const size_t yn)
+{
+    const bool less = (xn == yn || x[xn - 1] == 0) && cmp_n(x, y, yn) < 0;
+    if (less) {
+        sub_n(r, y, x, yn);
+        std::fill(r + yn, r + xn, 0);
+    } else {
+        limb_t borrow = sub_n(r, x, y, yn);
+        for (size_t i = yn; i < xn; ++i) {
+            r[i] = sub_borrow(x[i], 0, borrow);
+        }
+    }
+    return less;
+}
+
+// Two's complement helpers over n limbs for the Toom-3 interpolation.
+void negate(limb_t* x, const size_t n)
+{
+    limb_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = sub_borrow(0, x[i], borrow);
+    }
+}
+
+void shift_right_1(limb_t* x, const size_t n)
+{
+    for (size_t i = 0; i + 1 < n; ++i) {
+        x[i] = (x[i] >> 1) | (x[i + 1] << 63);
+    }
+    x[n - 1] = limb_t(int64_t(x[n - 1]) >> 1);
+}
+
+void shift_left(limb_t* r, const limb_t* x, const size_t n, const unsigned bits)
+{
+    for (size_t i = n - 1; i != 0; --i) {
+        r[i] = (x[i] << bits) | (x[i - 1] >> (64 - bits));
+    }
+    r[0] = x[0] << bits;
+}
+
+// x /= 3 for x divisible by 3, by multiplying with 3^-1 mod 2^64 limb by limb.
+void divexact_by3(limb_t* x, const size_t n)
+{
+    const limb_t inverse = 0xAAAAAAAAAAAAAAABull;
+    limb_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const limb_t next_borrow = x[i] < borrow;
+        const limb_t q = (x[i] - borrow) * inverse;
+        x[i] = q;
+        limb_t hi = 0;
+        mul_wide(q, 3, hi);
+        borrow = hi + next_borrow;
+    }
+}
+
+template <bool SQUARE>
+size_t scratch_size(const size_t n)
+{
+    if (n < (SQUARE ? sqr_karatsuba_threshold : karatsuba_threshold)) {
+        return 0;
+    }
+    if (n < (SQUARE ? sqr_toom3_threshold : toom3_threshold)) {
+        const size_t m = n - n / 2;
+        return 6 * m + 1 + scratch_size<SQUARE>(m);
+    }
+    const size_t k = (n + 2) / 3;
+    return 6 * (k + 1) + 4 * (2 * k + 2) + scratch_size<SQUARE>(k + 1);
+}
+
+template <bool SQUARE>
+void product_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, limb_t* scratch);
+
+// a * b = z0 + (z0 + z2 + (a0 - a1)(b1 - b0)) B^m + z2 B^2m with z0 = a0 b0 and z2 = a1 b1.
+template <bool SQUARE>
+void karatsuba(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, limb_t* scratch)
+{
+    const size_t m = n - n / 2;
+    const size_t h = n / 2;
+    limb_t* da = scratch;
+    limb_t* db = scratch + m;
+    limb_t* t = scratch + 2 * m;
+    limb_t* mid = scratch + 4 * m;
+    limb_t* next = scratch + 6 * m + 1;
+
+    product_n<SQUARE>(r, a, b, m, next);
+    product_n<SQUARE>(r + 2 * m, a + m, b + m, h, next);
+
+    bool add = false;
+    const bool a_less = abs_diff(da, a, m, a + m, h);
+    if (SQUARE) {
+        product_n<true>(t, da, da, m, next);
+    } else {
+        add = a_less != abs_diff(db, b, m, b + m, h);
+        product_n<false>(t, da, db, m, next);
+    }
+
+    std::copy(r, r + 2 * m, mid);
+    mid[2 * m] = 0;
+    add_at(mid, 2 * m + 1, 0, r + 2 * m, 2 * h);
+    if (add) {
+        mid[2 * m] += add_n(mid, mid, t, 2 * m);
+    } else {
+        mid[2 * m] -= sub_n(mid, mid, t, 2 * m);
+    }
+    add_at(r, 2 * n, m, mid, 2 * m + 1);
+}
+
+// Evaluates x0 + x1 X + x2 X^2 at 1, -1 and 2 into k + 1 limbs each, returns true if the
+// value at -1 is negative (em1 holds its magnitude).
+bool toom3_evaluate(const limb_t* x, const size_t k, const size_t l, limb_t* e1, limb_t* em1, limb_t* e2)
+{
+    std::copy(x, x + k, em1);
+    em1[k] = 0;
+    add_at(em1, k + 1, 0, x + 2 * k, l);
+    std::copy(em1, em1 + k + 1, e1);
+    add_at(e1, k + 1, 0, x + k, k);
+    const bool negative = abs_diff(em1, em1, k + 1, x + k, k);
+
+    std::fill(e2, e2 + k + 1, 0);
+    std::copy(x + 2 * k, x + 2 * k + l, e2);
+    shift_left(e2, e2, k + 1, 1);
+    add_at(e2, k + 1, 0, x + k, k);
+    shift_left(e2, e2, k + 1, 1);
+    add_at(e2, k + 1, 0, x, k);
+    return negative;
+}
+
+// Splits the operands in three and multiplies the polynomials at 0, 1, -1, 2 and infinity.
+template <bool SQUARE>
+void toom3(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, limb_t* scratch)
+{
+    const size_t k = (n + 2) / 3;
+    const size_t l = n - 2 * k;
+    const size_t length = 2 * k + 2;
+    limb_t* ea1 = scratch;
+    limb_t* eam1 = ea1 + (k + 1);
+    limb_t* ea2 = eam1 + (k + 1);
+    limb_t* eb1 = ea2 + (k + 1);
+    limb_t* ebm1 = eb1 + (k + 1);
+    limb_t* eb2 = ebm1 + (k + 1);
+    limb_t* r1 = scratch + 6 * (k + 1);
+    limb_t* rm1 = r1 + length;
+    limb_t* r2 = rm1 + length;
+    limb_t* t = r2 + length;
+    limb_t* next = t + length;
+
+    bool negative = toom3_evaluate(a, k, l, ea1, eam1, ea2);
+    if (SQUARE) {
+        negative = false;
+        product_n<true>(r1, ea1, ea1, k + 1, next);
+        product_n<true>(rm1, eam1, eam1, k + 1, next);
+        product_n<true>(r2, ea2, ea2, k + 1, next);
+    } else {
+        negative ^= toom3_evaluate(b, k, l, eb1, ebm1, eb2);
+        product_n<false>(r1, ea1, eb1, k + 1, next);
+        product_n<false>(rm1, eam1, ebm1, k + 1, next);
+        product_n<false>(r2, ea2, eb2, k + 1, next);
+    }
+    if (negative) {
+        negate(rm1, length);
+    }
+    product_n<SQUARE>(r, a, b, k, next);
+    product_n<SQUARE>(r + 4 * k, a + 2 * k, b + 2 * k, l, next);
+    std::fill(r + 2 * k, r + 4 * k, 0);
+
+    // With c0 = r[0, 2k) and c4 = r[4k, 2n) in place:
+    // c2 = (r1 + rm1) / 2 - c0 - c4, d = (r1 - rm1) / 2 = c1 + c3,
+    // e = (r2 - c0 - 4 c2 - 16 c4) / 2 = c1 + 4 c3, c3 = (e - d) / 3, c1 = d - c3.
+    add_n(t, r1, rm1, length);
+    shift_right_1(t, length);
+    sub_n(rm1, r1, rm1, length);
+    shift_right_1(rm1, length);
+    sub_from(t, length, r, 2 * k);
+    sub_from(t, length, r + 4 * k, 2 * l);
+
+    sub_from(r2, length, r, 2 * k);
+    shift_left(r1, t, length, 2);
+    sub_n(r2, r2, r1, length);
+    std::fill(r1, r1 + length, 0);
+    std::copy(r + 4 * k, r + 4 * k + 2 * l, r1);
+    shift_left(r1, r1, length, 4);
+    sub_n(r2, r2, r1, length);
+    shift_right_1(r2, length);
+
+    sub_n(r2, r2, rm1, length);
+    divexact_by3(r2, length);
+    sub_n(rm1, rm1, r2, length);
+
+    add_at(r, 2 * n, k, rm1, length);
+    add_at(r, 2 * n, 2 * k, t, length);
+    add_at(r, 2 * n, 3 * k, r2, length);
+}
+
+template <bool SQUARE>
+void product_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, limb_t* scratch)
+{
+    if (n < (SQUARE ? sqr_karatsuba_threshold : karatsuba_threshold)) {
+        if (SQUARE) {
+            sqr_basecase(r, a, n);
+        } else {
+            mul_basecase(r, a, n, b, n);
+        }
+    } else if (n < (SQUARE ? sqr_toom3_threshold : toom3_threshold)) {
+        karatsuba<SQUARE>(r, a, b, n, scratch);
+    } else {
+        toom3<SQUARE>(r, a, b, n, scratch);
+    }
+}
+
+template <bool SQUARE>
+void product_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n)
+{
+    const size_t size = scratch_size<SQUARE>(n);
+    limb_t local[1024];
+    if (size <= 1024) {
+        product_n<SQUARE>(r, a, b, n, local);
+    } else {
+        ScratchScope scope;
+        product_n<SQUARE>(r, a, b, n, scope.allocate(size));
+    }
+}
+
+} // namespace
+
+void mul_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n)
+{
+    product_n<false>(r, a, b, n);
+}
+
+void sqr(limb_t* r, const limb_t* a, const size_t n)
+{
+    product_n<true>(r, a, a, n);
+}
+
+void mul(limb_t* r, const limb_t* a, const size_t an, const limb_t* b, const size_t bn)
+{
+    if (bn < karatsuba_threshold) {
+        mul_basecase(r, a, an, b, bn);
+        return;
+    }
+    if (an == bn) {
+        mul_n(r, a, b, bn);
+        return;
+    }
+    // Unbalanced operands are multiplied as bn-limb slices of a.
+    std::fill(r, r + an + bn, 0);
+    ScratchScope scope;
+    limb_t* slice = scope.allocate(2 * bn);
+    for (size_t offset = 0; offset < an; offset += bn) {
+        const size_t size = std::min(bn, an - offset);
+        if (size == bn) {
+            mul_n(slice, a + offset, b, bn);
+        } else {
+            mul(slice, b, bn, a + offset, size);
+        }
+        add_at(r, an + bn, offset, slice, size + bn);
+    }
+}
+
+limb_t divrem_1(limb_t* q, const limb_t* a, const size_t an, const limb_t d)
+{
+    // Dividing a * 2^shift by d * 2^shift gives the same quotient with a normalized divisor.
+    const unsigned shift = count_leading_zeros(d);
+    const limb_t normalized = d << shift;
+    limb_t rem = shift == 0 ? 0 : a[an - 1] >> (64 - shift);
+    for (size_t i = an; i != 0; --i) {
+        limb_t limb = a[i - 1] << shift;
+        if (shift != 0 && i > 1) {
+            limb |= a[i - 2] >> (64 - shift);
+        }
+        q[i - 1] = div_wide(rem, limb, normalized, rem);
+    }
+    return rem >> shift;
+}
+
+void divrem(limb_t* q, limb_t* r, const limb_t* a, const size_t an, const limb_t* b, const size_t bn)
+{
+    // Normalize so that the top limb of the divisor has its top bit set, which keeps every
+    // quotient digit estimate within two of the true digit.
+    const unsigned shift = count_leading_zeros(b[bn - 1]);
+    limb_t local[1024];
+    ScratchScope scope;
+    limb_t* v = an + 1 + bn <= 1024 ? local : scope.allocate(an + 1 + bn);
+    limb_t* u = v + bn;
+    if (shift == 0) {
+        std::copy(b, b + bn, v);
+        std::copy(a, a + an, u);
+        u[an] = 0;
+    } else {
+        for (size_t i = bn - 1; i != 0; --i) {
+            v[i] = (b[i] << shift) | (b[i - 1] >> (64 - shift));
+        }
+        v[0] = b[0] << shift;
+        u[an] = a[an - 1] >> (64 - shift);
+        for (size_t i = an - 1; i != 0; --i) {
+            u[i] = (a[i] << shift) | (a[i - 1] >> (64 - shift));
+        }
+        u[0] = a[0] << shift;
+    }
+
+    const limb_t v_top = v[bn - 1];
+    const limb_t v_next = v[bn - 2];
+    for (size_t j = an - bn + 1; j != 0; --j) {
+        limb_t* window = u + j - 1;
+        limb_t q_hat = 0;
+        limb_t r_hat = 0;
+        bool refine = true;
+        if (window[bn] == v_top) {
+            q_hat = ~limb_t(0);
+            r_hat = window[bn - 1] + v_top;
+            refine = r_hat >= v_top;
+        } else {
+            q_hat = div_wide(window[bn], window[bn - 1], v_top, r_hat);
+        }
+        while (refine) {
+            limb_t hi = 0;
+            const limb_t lo = mul_wide(q_hat, v_next, hi);
+            if (hi < r_hat || (hi == r_hat && lo <= window[bn - 2])) {
+                break;
+            }
+            --q_hat;
+            r_hat += v_top;
+            refine = r_hat >= v_top;
+        }
+
+        const limb_t borrow = submul_1(window, v, bn, q_hat);
+        const bool negative = window[bn] < borrow;
+        window[bn] -= borrow;
+        if (negative) {
+            --q_hat;
+            window[bn] += add_n(window, window, v, bn);
+        }
+        if (q != nullptr) {
+            q[j - 1] = q_hat;
+        }
+    }
+
+    if (r == nullptr) {
+        return;
+    }
+    if (shift == 0) {
+        std::copy(u, u + bn, r);
+    } else {
+        for (size_t i = 0; i + 1 < bn; ++i) {
+            r[i] = (u[i] >> shift) | (u[i + 1] << (64 - shift));
+        }
+        r[bn - 1] = u[bn - 1] >> shift;
+    }
+}
+
+} // namespace limbs
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SIZEOF_INT128__)
+#define E2EE_HAS_INT128 1
+#endif
+
+namespace limbs {
+
+using limb_t = uint64_t;
+
+// Returns the low half of a * b, stores the high half in hi.
+constexpr limb_t mul_wide(const limb_t a, const limb_t b, limb_t& hi)
+{
+#ifdef E2EE_HAS_INT128
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    hi = (limb_t)(product >> 64);
+    return (limb_t)product;
+#else
+    const limb_t a_lo = (uint32_t)a;
+    const limb_t a_hi = a >> 32;
+    const limb_t b_lo = (uint32_t)b;
+    const limb_t b_hi = b >> 32;
+    const limb_t lo_lo = a_lo * b_lo;
+    const limb_t hi_lo = a_hi * b_lo;
+    const limb_t lo_hi = a_lo * b_hi;
+    const limb_t hi_hi = a_hi * b_hi;
+    const limb_t middle = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    hi = hi_hi + (hi_lo >> 32) + (middle >> 32);
+    return (middle << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+// Returns the low half of a * b + c + d, stores the high half in hi. Never overflows.
+constexpr limb_t mul_add(const limb_t a, const limb_t b, const limb_t c, const limb_t d, limb_t& hi)
+{
+#ifdef E2EE_HAS_INT128
+    const unsigned __int128 result = (unsigned __int128)a * b + c + d;
+    hi = (limb_t)(result >> 64);
+    return (limb_t)result;
+#else
+    limb_t lo = mul_wide(a, b, hi);
+    lo += c;
+    hi += (lo < c);
+    lo += d;
+    hi += (lo < d);
+    return lo;
+#endif
+}
+
+// Returns a + b + carry, carry is updated to the outgoing carry (0 or 1).
+constexpr limb_t add_carry(const limb_t a, const limb_t b, limb_t& carry)
+{
+    const limb_t sum = a + b;
+    const limb_t result = sum + carry;
+    carry = (sum < a) | (result < sum);
+    return result;
+}
+
+// Returns a - b - borrow, borrow is updated to the outgoing borrow (0 or 1).
+constexpr limb_t sub_borrow(const limb_t a, const limb_t b, limb_t& borrow)
+{
+    const limb_t diff = a - b;
+    const limb_t result = diff - borrow;
+    borrow = (a < b) | (diff < borrow);
+    return result;
+}
+
+// Returns the number of leading zero bits of a non-zero x.
+constexpr unsigned count_leading_zeros(const limb_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    unsigned count = 0;
+    for (limb_t bit = limb_t(1) << 63; (x & bit) == 0; bit >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Returns (hi * 2^64 + lo) / d and stores the remainder in rem. d must have its top bit set
+// and hi must be less than d, so the quotient fits in one limb.
+constexpr limb_t div_wide(const limb_t hi, const limb_t lo, const limb_t d, limb_t& rem)
+{
+#ifdef E2EE_HAS_INT128
+    const unsigned __int128 dividend = ((unsigned __int128)hi << 64) | lo;
+    rem = (limb_t)(dividend % d);
+    return (limb_t)(dividend / d);
+#else
+    // Two rounds of schoolbook division by the 32-bit halves of d.
+    const limb_t d_hi = d >> 32;
+    const limb_t d_lo = (uint32_t)d;
+    limb_t quotient[2] = {};
+    limb_t r = hi;
+    for (int round = 0; round < 2; ++round) {
+        const limb_t next = round == 0 ? lo >> 32 : (uint32_t)lo;
+        limb_t q = r / d_hi;
+        limb_t r_hat = r % d_hi;
+        while ((q >> 32) != 0 || q * d_lo > ((r_hat << 32) | next)) {
+            --q;
+            r_hat += d_hi;
+            if ((r_hat >> 32) != 0) {
+                break;
+            }
+        }
+        r = ((r << 32) | next) - q * d;
+        quotient[round] = q;
+    }
+    rem = r;
+    return (quotient[0] << 32) | quotient[1];
+#endif
+}
+
+// Kernels over little-endian limb arrays. Output arrays may alias an input only
+// where noted. Comparison and select use AVX2 when the CPU supports it.
+
+// r = a + b over n limbs, returns the outgoing carry. r may alias a or b.
+limb_t add_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n);
+// r = a - b over n limbs, returns the outgoing borrow. r may alias a or b.
+limb_t sub_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n);
+// Returns -1, 0 or 1 as a is less than, equal to or greater than b.
+int cmp_n(const limb_t* a, const limb_t* b, const size_t n);
+// Returns whether a equals b.
+bool eq_n(const limb_t* a, const limb_t* b, const size_t n);
+// r = condition ? a : b over n limbs, with no branch on condition. r may alias a or b.
+void select_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n, const bool condition);
+// r = (a + b) mod p for a, b < p over n limbs, at most add_mod_max, with no branch on the
+// values. r may alias a or b.
+const size_t add_mod_max = 128;
+void add_mod_n(limb_t* r, const limb_t* a, const limb_t* b, const limb_t* p, const size_t n);
+// r = a * b over n limbs, returns the high limb. r may alias a.
+limb_t mul_1(limb_t* r, const limb_t* a, const size_t n, const limb_t b);
+// r += a * b over n limbs, returns the carry out of r[n - 1].
+limb_t addmul_1(limb_t* r, const limb_t* a, const size_t n, const limb_t b);
+// r -= a * b over n limbs, returns the borrow out of r[n - 1].
+limb_t submul_1(limb_t* r, const limb_t* a, const size_t n, const limb_t b);
+// r[0, an + bn) = a * b. r must not alias a or b.
+void mul_basecase(limb_t* r, const limb_t* a, const size_t an, const limb_t* b, const size_t bn);
+// r[0, 2n) = a * a. r must not alias a.
+void sqr_basecase(limb_t* r, const limb_t* a, const size_t n);
+
+// Operand sizes, in limbs, from which the balanced products switch from the schoolbook
+// kernels to Karatsuba and from Karatsuba to Toom-3.
+const size_t karatsuba_threshold = 32;
+const size_t toom3_threshold = 192;
+const size_t sqr_karatsuba_threshold = 64;
+const size_t sqr_toom3_threshold = 192;
+
+// r[0, 2n) = a * b. r must not alias a or b.
+void mul_n(limb_t* r, const limb_t* a, const limb_t* b, const size_t n);
+// r[0, 2n) = a * a. r must not alias a.
+void sqr(limb_t* r, const limb_t* a, const size_t n);
+// r[0, an + bn) = a * b for an >= bn > 0. r must not alias a or b.
+void mul(limb_t* r, const limb_t* a, const size_t an, const limb_t* b, const size_t bn);
+
+// q[0, an) = a / d, returns a % d. d must be non-zero. q may alias a.
+limb_t divrem_1(limb_t* q, const limb_t* a, const size_t an, const limb_t d);
+// Knuth's Algorithm D: q[0, an - bn + 1) = a / b and r[0, bn) = a % b for an >= bn >= 2
+// and b[bn - 1] != 0. Either q or r may be null if not needed. a and b are copied before
+// anything is written, so q or r may alias them, but not each other.
+void divrem(limb_t* q, limb_t* r, const limb_t* a, const size_t an, const limb_t* b, const size_t bn);
+
+} // namespace limbs
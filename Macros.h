@@ -1,30 +1,51 @@
 #pragma once
 
-#define SINGLETON_DECL(Class) \
+#include <atomic>
+#include <mutex>
+
+// A process-wide default instance next to ordinary construction. get_instance() is safe to call
+// from any thread: the instance is published through an atomic pointer and created at most once
+// under s_instanceMutex. remove_instance() must not race with threads still using the instance.
+#define DEFAULT_INSTANCE_DECL(Class) \
 public:\
     static Class* get_instance();\
     static void remove_instance();\
 private:\
-    static Class* s_instance;\
-    Class();\
-    ~Class();\
-    Class(const Class&) = delete;\
-    Class(Class&&) = delete;\
-    Class& operator=(const Class&) = delete;\
-    Class& operator=(Class&&) = delete;
+    static std::atomic<Class*> s_instance;\
+    static std::mutex s_instanceMutex;
 
-#define SINGLETON_DEF(Class) \
-Class* Class::s_instance = nullptr;\
+#define DEFAULT_INSTANCE_DEF(Class) \
+std::atomic<Class*> Class::s_instance(nullptr);\
+std::mutex Class::s_instanceMutex;\
 Class* Class::get_instance()\
 {\
-    if (s_instance == nullptr) {\
-        s_instance = new Class();\
+    Class* instance = s_instance.load(std::memory_order_acquire);\
+    if (instance == nullptr) {\
+        std::lock_guard<std::mutex> lock(s_instanceMutex);\
+        instance = s_instance.load(std::memory_order_relaxed);\
+        if (instance == nullptr) {\
+            instance = new Class();\
+            s_instance.store(instance, std::memory_order_release);\
+        }\
     }\
-    return s_instance;\
+    return instance;\
 }\
 void Class::remove_instance()\
 {\
-    delete s_instance;\
-    s_instance = nullptr;\
+    std::lock_guard<std::mutex> lock(s_instanceMutex);\
+    delete s_instance.exchange(nullptr);\
 }
 
+// The default instance as the only instance.
+#define SINGLETON_DECL(Class) \
+    DEFAULT_INSTANCE_DECL(Class)\
+private:\
+    Class();\
+    ~Class();\
+    Class(const Class&) = delete;\
+    Class(Class&&) = delete;\
+    Class& operator=(const Class&) = delete;\
+    Class& operator=(Class&&) = delete;
+
+#define SINGLETON_DEF(Class) \
+    DEFAULT_INSTANCE_DEF(Class)
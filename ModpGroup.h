@@ -0,0 +1,130 @@
+#pragma once
+
+#include "FixedBigInt.h"
+
+// Group parameters and the reduction constants derived from them, all evaluated at compile
+// time so that setting up an Engine does no parsing or division.
+namespace modp {
+
+// -p^-1 mod 2^64 for an odd p, by Newton iteration.
+template <size_t Bits>
+E2EE_CONSTEVAL limbs::limb_t montgomery_inverse(const FixedBigInt<Bits>& p)
+{
+    limbs::limb_t inverse = p[0];
+    for (int i = 0; i < 5; ++i) {
+        inverse *= 2 - p[0] * inverse;
+    }
+    return 0 - inverse;
+}
+
+// Replaces remainder with remainder * 2^64 mod p and returns floor(remainder * 2^64 / p), one step
+// of schoolbook division. remainder must be less than p and p must have its top bit set.
+template <size_t Bits>
+E2EE_CONSTEVAL limbs::limb_t shift_limb_mod(FixedBigInt<Bits>& remainder, const FixedBigInt<Bits>& p)
+{
+    using limbs::limb_t;
+    constexpr size_t n = FixedBigInt<Bits>::units;
+    if (n < 2 || (p[n - 1] >> 63) == 0) {
+        throw std::invalid_argument("Modulus must have its top bit set.");
+    }
+
+    // The estimate from the top two limbs overshoots the quotient digit by at most two.
+    limb_t q = ~limb_t(0);
+    if (remainder[n - 1] < p[n - 1]) {
+        limb_t rest = 0;
+        q = limbs::div_wide(remainder[n - 1], remainder[n - 2], p[n - 1], rest);
+    }
+
+    limb_t t[n + 1] = {};
+    for (size_t i = 0; i < n; ++i) {
+        t[i + 1] = remainder[i];
+    }
+    limb_t carry = 0;
+    limb_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const limb_t product = limbs::mul_add(q, p[i], carry, 0, carry);
+        t[i] = limbs::sub_borrow(t[i], product, borrow);
+    }
+    t[n] = limbs::sub_borrow(t[n], carry, borrow);
+    while (borrow != 0) {
+        --q;
+        limb_t add_back = 0;
+        for (size_t i = 0; i < n; ++i) {
+            t[i] = limbs::add_carry(t[i], p[i], add_back);
+        }
+        t[n] = limbs::add_carry(t[n], 0, add_back);
+        borrow = add_back == 0;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        remainder[i] = t[i];
+    }
+    return q;
+}
+
+// 2^exponent mod p. p must have its top bit set.
+template <size_t Bits>
+E2EE_CONSTEVAL FixedBigInt<Bits> power_of_two_mod(const size_t exponent, const FixedBigInt<Bits>& p)
+{
+    FixedBigInt<Bits> remainder = FixedBigInt<Bits>(1) << (exponent % 64);
+    for (size_t i = 0; i < exponent / 64; ++i) {
+        shift_limb_mod(remainder, p);
+    }
+    return remainder;
+}
+
+// floor(2^exponent / p). p must have its top bit set and the quotient must fit in Bits + 64 bits.
+template <size_t Bits>
+E2EE_CONSTEVAL FixedBigInt<Bits + 64> power_of_two_div(const size_t exponent, const FixedBigInt<Bits>& p)
+{
+    constexpr size_t quotient_units = FixedBigInt<Bits + 64>::units;
+    FixedBigInt<Bits + 64> quotient;
+    FixedBigInt<Bits> remainder = FixedBigInt<Bits>(1) << (exponent % 64);
+    for (size_t i = 0; i < exponent / 64; ++i) {
+        if (quotient[quotient_units - 1] != 0) {
+            throw std::overflow_error("Quotient does not fit in a fixed width integer.");
+        }
+        quotient = quotient << 64;
+        quotient[0] = shift_limb_mod(remainder, p);
+    }
+    return quotient;
+}
+
+// RFC 3526 group 15: the 3072-bit MODP prime 2^3072 - 2^3008 - 1 + 2^64 * (floor(2^2942 * pi) + 1690314).
+constexpr size_t group15_bits = 3072;
+using Group15Int = FixedBigInt<group15_bits>;
+constexpr size_t group15_units = Group15Int::units;
+
+constexpr Group15Int group15_prime = fixed_from_hex<group15_bits>(
+    "0x" "FFFFFFFF" "FFFFFFFF" "C90FDAA2" "2168C234" "C4C6628B" "80DC1CD1"
+         "29024E08" "8A67CC74" "020BBEA6" "3B139B22" "514A0879" "8E3404DD"
+         "EF9519B3" "CD3A431B" "302B0A6D" "F25F1437" "4FE1356D" "6D51C245"
+         "E485B576" "625E7EC6" "F44C42E9" "A637ED6B" "0BFF5CB6" "F406B7ED"
+         "EE386BFB" "5A899FA5" "AE9F2411" "7C4B1FE6" "49286651" "ECE45B3D"
+         "C2007CB8" "A163BF05" "98DA4836" "1C55D39A" "69163FA8" "FD24CF5F"
+         "83655D23" "DCA3AD96" "1C62F356" "208552BB" "9ED52907" "7096966D"
+         "670C354E" "4ABC9804" "F1746C08" "CA18217C" "32905E46" "2E36CE3B"
+         "E39E772C" "180E8603" "9B2783A2" "EC07A28F" "B5C55DF0" "6F4C52C9"
+         "DE2BCBF6" "95581718" "3995497C" "EA956AE5" "15D22618" "98FA0510"
+         "15728E5A" "8AAAC42D" "AD33170D" "04507A33" "A85521AB" "DF1CBA64"
+         "ECFB8504" "58DBEF0A" "8AEA7157" "5D060C7D" "B3970F85" "A6E1E4C7"
+         "ABF5AE8C" "DB0933D7" "1E8C94E0" "4A25619D" "CEE3D226" "1AD2EE6B"
+         "F12FFA06" "D98A0864" "D8760273" "3EC86A64" "521F2B18" "177B200C"
+         "BBE11757" "7A615D6C" "770988C0" "BAD946E2" "08E24FA0" "74E5AB31"
+         "43DB5BFC" "E0FD108E" "4B82D120" "A93AD2CA" "FFFFFFFF" "FFFFFFFF");
+constexpr Group15Int group15_generator(2);
+
+// Montgomery constants with R = 2^3072.
+constexpr limbs::limb_t group15_montgomery_inverse = montgomery_inverse(group15_prime);
+constexpr Group15Int group15_montgomery_one = power_of_two_mod(group15_bits, group15_prime);
+constexpr Group15Int group15_montgomery_r_squared = power_of_two_mod(2 * group15_bits, group15_prime);
+
+// Barrett constant mu = floor(2^6144 / p), group15_units + 1 limbs.
+constexpr FixedBigInt<group15_bits + 64> group15_barrett_mu = power_of_two_div(2 * group15_bits, group15_prime);
+
+static_assert(group15_prime[0] == ~limbs::limb_t(0) && group15_prime[group15_units - 1] == ~limbs::limb_t(0),
+              "Group 15 prime must be in the form SpecialFormContext supports.");
+static_assert(group15_prime[0] * group15_montgomery_inverse == ~limbs::limb_t(0),
+              "Montgomery inverse must satisfy p * p' = -1 mod 2^64.");
+
+} // namespace modp
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "BigInteger.h"
+
+// Sliding-window square-and-multiply over a modular context. ContextT keeps residues as
+// size()-limb arrays and provides to_residue(), from_residue(), one(), multiply() and square().
+// ExponentT is any integer type with bit_length() and test_bit(). result may alias base.
+template <typename ContextT, typename ExponentT>
+void window_pow_mod(const ContextT& context, typename ContextT::unit_t* result,
+                    const typename ContextT::unit_t* base, const ExponentT& exponent)
+{
+    using unit_t = typename ContextT::unit_t;
+
+    const size_t n = context.size();
+    const size_t exponent_bits = exponent.bit_length();
+    const size_t window = BigInteger::window_size(exponent_bits);
+
+    // odd_powers[i * n, (i + 1) * n) = base ^ (2 * i + 1)
+    unit_t odd_powers[(size_t(1) << 5) * ContextT::max_units];
+    std::copy(base, base + n, odd_powers);
+    if (window > 1) {
+        unit_t base_squared[ContextT::max_units];
+        context.square(base_squared, odd_powers);
+        for (size_t i = 1; i < (size_t(1) << (window - 1)); ++i) {
+            context.multiply(odd_powers + i * n, odd_powers + (i - 1) * n, base_squared);
+        }
+    }
+
+    std::copy(context.one(), context.one() + n, result);
+    size_t i = exponent_bits;
+    while (i != 0) {
+        if (!exponent.test_bit(i - 1)) {
+            context.square(result, result);
+            --i;
+            continue;
+        }
+        size_t length = std::min(window, i);
+        while (!exponent.test_bit(i - length)) {
+            --length;
+        }
+        size_t value = 0;
+        for (size_t j = 0; j < length; ++j) {
+            value = (value << 1) | exponent.test_bit(i - 1 - j);
+            context.square(result, result);
+        }
+        context.multiply(result, result, odd_powers + (value >> 1) * n);
+        i -= length;
+    }
+}
+
+template <typename ContextT>
+BigInteger window_pow_mod(const ContextT& context, const BigInteger& base, const BigInteger& exponent)
+{
+    if (exponent < 0) {
+        throw std::domain_error("Negative exponent.");
+    }
+    typename ContextT::unit_t residue[ContextT::max_units];
+    context.to_residue(residue, base);
+    window_pow_mod(context, residue, residue, exponent);
+    return context.from_residue(residue);
+}
+
+// result = 2 ^ exponent as a residue of context. The leading bits of the exponent become a
+// single shifted one, the rest is squarings and modular doublings, with no multiplications.
+template <typename ContextT, typename ExponentT>
+void two_pow_mod(const ContextT& context, typename ContextT::unit_t* result, const ExponentT& exponent)
+{
+    using unit_t = typename ContextT::unit_t;
+
+    const size_t n = context.size();
+    const size_t modulus_bits = context.modulus().bit_length();
+
+    size_t i = exponent.bit_length();
+    size_t head = 0;
+    while (i != 0 && ((head << 1) | exponent.test_bit(i - 1)) + 1 < modulus_bits) {
+        head = (head << 1) | exponent.test_bit(i - 1);
+        --i;
+    }
+    std::fill(result, result + n, unit_t(0));
+    result[head / 64] = unit_t(1) << (head % 64);
+    context.to_residue(result, result);
+
+    for (; i != 0; --i) {
+        context.square(result, result);
+        if (exponent.test_bit(i - 1)) {
+            context.add(result, result, result);
+        }
+    }
+}
+
+// Lim-Lee comb for exponentiation of a fixed base. The exponent bits are split into
+// teeth rows of span() bits, and the table holds the base raised to every combination of
+// one bit per row, so an exponent costs at most span() squarings and multiplications
+// instead of one squaring per exponent bit. Built once, shared read-only afterwards.
+template <typename ContextT>
+class FixedBaseComb
+{
+public:
+    using unit_t = typename ContextT::unit_t;
+
+    static const size_t teeth = 8;
+
+    // base is an n-limb ordinary value, exponents may be up to 64 * n bits long.
+    FixedBaseComb(const ContextT& context, const unit_t* base)
+        : m_context(context)
+        , m_span(span(context))
+        , m_table((size_t(1) << teeth) * context.size())
+    {
+        const size_t n = m_context.size();
+        std::copy(m_context.one(), m_context.one() + n, entry(0));
+        m_context.to_residue(entry(1), base);
+        for (size_t j = 1; j < teeth; ++j) {
+            unit_t* row = entry(size_t(1) << j);
+            std::copy(entry(size_t(1) << (j - 1)), entry(size_t(1) << (j - 1)) + n, row);
+            for (size_t k = 0; k < m_span; ++k) {
+                m_context.square(row, row);
+            }
+        }
+        for (size_t v = 3; v < (size_t(1) << teeth); ++v) {
+            if ((v & (v - 1)) != 0) {
+                m_context.multiply(entry(v), entry(v & (v - 1)), entry(v & (0 - v)));
+            }
+        }
+    }
+
+    // Number of squarings an exponentiation with a table for context costs at most.
+    static size_t span(const ContextT& context)
+    {
+        return (64 * context.size() + teeth - 1) / teeth;
+    }
+
+    // result = base ^ exponent % p as an n-limb ordinary value.
+    template <typename ExponentT>
+    void pow_mod(unit_t* result, const ExponentT& exponent) const
+    {
+        const size_t n = m_context.size();
+        const size_t exponent_bits = exponent.bit_length();
+        if (exponent_bits > teeth * m_span) {
+            throw std::invalid_argument("Exponent is too long for the comb table.");
+        }
+
+        std::copy(m_context.one(), m_context.one() + n, result);
+        for (size_t column = std::min(m_span, exponent_bits); column != 0; --column) {
+            m_context.square(result, result);
+            size_t v = 0;
+            for (size_t j = 0; j < teeth; ++j) {
+                v |= size_t(exponent.test_bit(j * m_span + column - 1)) << j;
+            }
+            if (v != 0) {
+                m_context.multiply(result, result, entry(v));
+            }
+        }
+        m_context.from_residue(result, result);
+    }
+
+private:
+    unit_t* entry(const size_t index)
+    {
+        return m_table.data() + index * m_context.size();
+    }
+
+    const unit_t* entry(const size_t index) const
+    {
+        return m_table.data() + index * m_context.size();
+    }
+
+private:
+    const ContextT&     m_context;
+    size_t              m_span;
+    std::vector<unit_t> m_table;
+};
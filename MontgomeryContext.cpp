@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "MontgomeryContext.h"
+
+MontgomeryContext::MontgomeryContext(const BigInteger& modulus)
+    : m_modulus(modulus)
+    , m_inverse(0)
+{
+    if (modulus <= 1 || !modulus.test_bit(0)) {
+        throw std::invalid_argument("Montgomery modulus must be odd and greater than one.");
+    }
+    const size_t n = modulus.unit_count();
+    if (n > max_units) {
+        throw std::invalid_argument("Montgomery modulus is too large.");
+    }
+    m_units.resize(n);
+    modulus.to_units(m_units.data(), n);
+
+    // Newton iteration for p^-1 mod 2^64, every step doubles the number of correct low bits.
+    unit_t inverse = m_units[0];
+    for (int i = 0; i < 5; ++i) {
+        inverse *= 2 - m_units[0] * inverse;
+    }
+    m_inverse = 0 - inverse;
+
+    unit_t power[2 * max_units + 1];
+    std::fill(power, power + 2 * n + 1, 0);
+    power[n] = 1;
+    m_one.resize(n);
+    (BigInteger::from_units(power, n + 1) % modulus).to_units(m_one.data(), n);
+    power[n] = 0;
+    power[2 * n] = 1;
+    m_r_squared.resize(n);
+    (BigInteger::from_units(power, 2 * n + 1) % modulus).to_units(m_r_squared.data(), n);
+}
+
+MontgomeryContext::MontgomeryContext(const unit_t* modulus, size_t n, unit_t inverse, const unit_t* r_squared, const unit_t* one)
+    : m_modulus(BigInteger::from_units(modulus, n))
+    , m_units(modulus, modulus + n)
+    , m_r_squared(r_squared, r_squared + n)
+    , m_one(one, one + n)
+    , m_inverse(inverse)
+{
+    if (n == 0 || n > max_units || m_units.back() == 0 || (m_units.front() & 1) == 0) {
+        throw std::invalid_argument("Montgomery modulus must be odd and at most max_units limbs long.");
+    }
+}
+
+const BigInteger& MontgomeryContext::modulus() const
+{
+    return m_modulus;
+}
+
+size_t MontgomeryContext::size() const
+{
+    return m_units.size();
+}
+
+void MontgomeryContext::add(unit_t* result, const unit_t* lhs, const unit_t* rhs) const
+{
+    limbs::add_mod_n(result, lhs, rhs, m_units.data(), size());
+}
+
+void MontgomeryContext::multiply(unit_t* result, const unit_t* lhs, const unit_t* rhs) const
+{
+    const size_t n = size();
+    unit_t product[2 * max_units];
+    limbs::mul_n(product, lhs, rhs, n);
+    reduce(result, product);
+}
+
+void MontgomeryContext::square(unit_t* result, const unit_t* value) const
+{
+    unit_t product[2 * max_units];
+    limbs::sqr(product, value, size());
+    reduce(result, product);
+}
+
+void MontgomeryContext::reduce(unit_t* result, const unit_t* value) const
+{
+    const size_t n = size();
+    unit_t t[2 * max_units];
+    std::copy(value, value + 2 * n, t);
+
+    unit_t top_carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const unit_t m = t[i] * m_inverse;
+        const unit_t carry = limbs::addmul_1(t + i, m_units.data(), n, m);
+        t[i + n] = limbs::add_carry(t[i + n], carry, top_carry);
+    }
+    // t + n is below 2p, p is subtracted unless that borrows past the carry. The result is
+    // selected without a branch, so the reduction takes the same time whatever its input.
+    unit_t difference[max_units];
+    const unit_t borrow = limbs::sub_n(difference, t + n, m_units.data(), n);
+    limbs::select_n(result, t + n, difference, n, top_carry < borrow);
+}
+
+const MontgomeryContext::unit_t* MontgomeryContext::one() const
+{
+    return m_one.data();
+}
+
+void MontgomeryContext::to_residue(unit_t* result, const BigInteger& value) const
+{
+    const size_t n = size();
+    unit_t units[max_units];
+    if (value < 0 || value.unit_count() > n) {
+        BigInteger reduced = value % m_modulus;
+        if (reduced < 0) {
+            reduced += m_modulus;
+        }
+        reduced.to_units(units, n);
+    } else {
+        value.to_units(units, n);
+    }
+    multiply(result, units, m_r_squared.data());
+}
+
+BigInteger MontgomeryContext::from_residue(const unit_t* value) const
+{
+    const size_t n = size();
+    unit_t t[2 * max_units] = {};
+    std::copy(value, value + n, t);
+    unit_t result[max_units];
+    reduce(result, t);
+    return BigInteger::from_units(result, n);
+}
+
+void MontgomeryContext::to_residue(unit_t* result, const unit_t* value) const
+{
+    multiply(result, value, m_r_squared.data());
+}
+
+void MontgomeryContext::from_residue(unit_t* result, const unit_t* value) const
+{
+    const size_t n = size();
+    unit_t t[2 * max_units] = {};
+    std::copy(value, value + n, t);
+    reduce(result, t);
+}
+
+BigInteger MontgomeryContext::pow_mod(const BigInteger& base, const BigInteger& exponent) const
+{
+    return window_pow_mod(*this, base, exponent);
+}
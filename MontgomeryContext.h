@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "BigInteger.h"
+#include "Limbs.h"
+#include "ModularExponentiation.h"
+
+// Precomputed state for Montgomery arithmetic modulo a fixed odd modulus p of n limbs.
+// Residues are kept as n-limb arrays in Montgomery form, x * R mod p with R = 2^(64 * n),
+// so that multiplication and squaring reduce without any division.
+class MontgomeryContext
+{
+public:
+    using unit_t = BigInteger::unit_t;
+
+    static const size_t max_units = 128;
+
+    explicit MontgomeryContext(const BigInteger& modulus);
+    // Takes the n-limb modulus with its constants already computed: inverse = -p^-1 mod 2^64,
+    // r_squared = R^2 mod p and one = R mod p.
+    MontgomeryContext(const unit_t* modulus, size_t n, unit_t inverse, const unit_t* r_squared, const unit_t* one);
+
+    const BigInteger& modulus() const;
+    size_t size() const;
+
+    // result = lhs + rhs mod p. result may alias lhs or rhs.
+    void add(unit_t* result, const unit_t* lhs, const unit_t* rhs) const;
+    // result = lhs * rhs * R^-1 mod p. result may alias lhs or rhs.
+    void multiply(unit_t* result, const unit_t* lhs, const unit_t* rhs) const;
+    // result = value * value * R^-1 mod p. result may alias value.
+    void square(unit_t* result, const unit_t* value) const;
+    // result = value[0, 2n) * R^-1 mod p, value must be less than p * R.
+    void reduce(unit_t* result, const unit_t* value) const;
+
+    void to_residue(unit_t* result, const BigInteger& value) const;
+    BigInteger from_residue(const unit_t* value) const;
+    // Conversions between n-limb ordinary values and residues. result may alias value.
+    void to_residue(unit_t* result, const unit_t* value) const;
+    void from_residue(unit_t* result, const unit_t* value) const;
+    // R mod p, the Montgomery form of one.
+    const unit_t* one() const;
+
+    // Computes (base ^ exponent) % p with sliding-window square-and-multiply.
+    BigInteger pow_mod(const BigInteger& base, const BigInteger& exponent) const;
+    // Same on n-limb ordinary values, for any exponent type with bit_length() and test_bit().
+    template <typename ExponentT>
+    void pow_mod(unit_t* result, const unit_t* base, const ExponentT& exponent) const
+    {
+        to_residue(result, base);
+        window_pow_mod(*this, result, result, exponent);
+        from_residue(result, result);
+    }
+
+private:
+    BigInteger          m_modulus;
+    std::vector<unit_t> m_units;
+    std::vector<unit_t> m_r_squared;
+    std::vector<unit_t> m_one;
+    unit_t              m_inverse;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "BoundedQueue.h"
+
+namespace E2EE {
+
+// Values produced ahead of time by a background thread. Whenever the pool drops below lowWater
+// values the thread refills it up to highWater; tryTake never waits for it.
+template <typename T>
+class PrecomputedPool
+{
+public:
+    PrecomputedPool(size_t lowWater, size_t highWater, std::function<T()> produce)
+        : m_queue(highWater)
+        , m_lowWater(lowWater)
+        , m_highWater(highWater)
+        , m_produce(std::move(produce))
+        , m_hits(0)
+        , m_misses(0)
+        , m_stopping(false)
+    {
+        if (highWater == 0 || lowWater > highWater) {
+            throw std::invalid_argument("Pool water marks must satisfy 0 <= low <= high and high > 0.");
+        }
+        m_thread = std::thread(&PrecomputedPool::run, this);
+    }
+
+    ~PrecomputedPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_one();
+        m_thread.join();
+    }
+
+    PrecomputedPool(const PrecomputedPool&) = delete;
+    PrecomputedPool& operator=(const PrecomputedPool&) = delete;
+
+    // Takes a value if one is ready, counting a hit, otherwise counts a miss and returns false.
+    bool tryTake(T& value)
+    {
+        const bool hit = m_queue.tryPop(value);
+        ++(hit ? m_hits : m_misses);
+        if (m_queue.size() < m_lowWater || !hit) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wakeUp.notify_one();
+        }
+        return hit;
+    }
+
+    size_t size() const
+    {
+        return m_queue.size();
+    }
+
+    uint64_t hits() const
+    {
+        return m_hits;
+    }
+
+    uint64_t misses() const
+    {
+        return m_misses;
+    }
+
+private:
+    void run()
+    {
+        for (;;) {
+            while (!m_stopping && m_queue.size() < m_highWater) {
+                if (!m_queue.tryPush(m_produce())) {
+                    break;
+                }
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this] { return m_stopping || m_queue.size() < std::max<size_t>(m_lowWater, 1); });
+            if (m_stopping) {
+                return;
+            }
+        }
+    }
+
+private:
+    BoundedQueue<T>         m_queue;
+    size_t                  m_lowWater;
+    size_t                  m_highWater;
+    std::function<T()>      m_produce;
+    std::atomic<uint64_t>   m_hits;
+    std::atomic<uint64_t>   m_misses;
+    std::mutex              m_mutex;
+    std::condition_variable m_wakeUp;
+    std::atomic<bool>       m_stopping;
+    std::thread             m_thread;
+};
+
+} // namespace E2EE
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "Scratch.h"
+
+namespace {
+
+using limbs::limb_t;
+
+// The arena of one thread: blocks filled in order, the next free limb is at m_offset in block
+// m_block. A request that does not fit moves on to the next block, the skipped tail stays
+// unused until the scope ends.
+class ScratchArena
+{
+public:
+    ScratchArena()
+        : m_block(0)
+        , m_offset(0)
+        , m_depth(0)
+    {}
+
+    void enter(size_t& block, size_t& offset)
+    {
+        block = m_block;
+        offset = m_offset;
+        ++m_depth;
+    }
+
+    void leave(const size_t block, const size_t offset)
+    {
+        m_block = block;
+        m_offset = offset;
+        if (--m_depth == 0 && m_blocks.size() > 1) {
+            // One block of the combined size, so the next operation of the same size fits
+            // without moving between blocks.
+            size_t size = 0;
+            for (const Block& existing : m_blocks) {
+                size += existing.size;
+            }
+            m_blocks.clear();
+            m_blocks.push_back(Block{std::unique_ptr<limb_t[]>(new limb_t[size]), size});
+        }
+    }
+
+    limb_t* allocate(const size_t count)
+    {
+        for (; m_block < m_blocks.size(); ++m_block, m_offset = 0) {
+            Block& block = m_blocks[m_block];
+            if (block.size - m_offset >= count) {
+                limb_t* result = block.data.get() + m_offset;
+                m_offset += count;
+                return result;
+            }
+        }
+        size_t size = min_block;
+        for (const Block& existing : m_blocks) {
+            size += existing.size;
+        }
+        size = std::max(size, count);
+        m_blocks.push_back(Block{std::unique_ptr<limb_t[]>(new limb_t[size]), size});
+        m_offset = count;
+        return m_blocks.back().data.get();
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<limb_t[]> data;
+        size_t                    size;
+    };
+
+    static const size_t min_block = 4096;
+
+    std::vector<Block> m_blocks;
+    size_t             m_block;
+    size_t             m_offset;
+    size_t             m_depth;
+};
+
+ScratchArena& arena()
+{
+    thread_local ScratchArena instance;
+    return instance;
+}
+
+} // namespace
+
+ScratchScope::ScratchScope()
+{
+    arena().enter(m_block, m_offset);
+}
+
+ScratchScope::~ScratchScope()
+{
+    arena().leave(m_block, m_offset);
+}
+
+limbs::limb_t* ScratchScope::allocate(const size_t count)
+{
+    return arena().allocate(count);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Limbs.h"
+
+// Temporary limb buffers from a per-thread bump allocator. Everything allocated in a scope is
+// released when it ends, and the arena keeps its memory for the next scope, so the arithmetic
+// kernels, which draw their temporaries from a scope of their own, stop calling malloc once the
+// arena has grown to their working size. Callers doing many operations in a row can open a
+// scope for their own buffers as well, and the kernels' scopes nest inside it.
+// Buffers are uninitialized. Scopes end in reverse order of opening, on the thread that opened
+// them, and only the innermost one may allocate.
+class ScratchScope
+{
+public:
+    ScratchScope();
+    ~ScratchScope();
+
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator= (const ScratchScope&) = delete;
+
+    limbs::limb_t* allocate(const size_t count);
+
+private:
+    size_t m_block;
+    size_t m_offset;
+};
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Snapshot.h"
+
+using namespace E2EE;
+using namespace E2EE::snapshot;
+
+namespace {
+
+const Byte magic[8] = {'E', '2', 'E', 'E', 'S', 'N', 'A', 'P'};
+const uint64_t prime = 0x100000001b3ull;
+
+// Whether the name of the record lies within the names section.
+bool nameInBounds(const Byte* record, uint64_t namesSize)
+{
+    const uint64_t offset = loadLittle(record, 8);
+    const uint64_t length = loadLittle(record + 8, 4);
+    return offset <= namesSize && length <= namesSize - offset;
+}
+
+// Everything after the header, handed to out in pieces.
+template <typename OutputF>
+void writeBody(const std::vector<Entry>& temporary, const std::vector<Entry>& permanent, OutputF out)
+{
+    Byte record[recordSize];
+    uint64_t nameOffset = 0;
+    for (const auto* table : {&temporary, &permanent}) {
+        for (const Entry& entry : *table) {
+            storeLittle(record, nameOffset, 8);
+            storeLittle(record + 8, entry.name.size(), 4);
+            storeLittle(record + 12, 0, 4);
+            if (entry.value != nullptr) {
+                for (size_t i = 0; i < Residue::units; ++i) {
+                    storeLittle(record + 16 + 8 * i, (*entry.value)[i], 8);
+                }
+            } else {
+                std::memcpy(record + 16, entry.encoded, valueSize);
+            }
+            out(record, recordSize);
+            nameOffset += entry.name.size();
+        }
+    }
+    for (const auto* table : {&temporary, &permanent}) {
+        for (const Entry& entry : *table) {
+            out(reinterpret_cast<const Byte*>(entry.name.data()), entry.name.size());
+        }
+    }
+}
+
+} // namespace
+
+void snapshot::storeLittle(Byte* out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = Byte(value >> (8 * i));
+    }
+}
+
+uint64_t snapshot::loadLittle(const Byte* in, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= uint64_t(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+Checksum::Checksum()
+    : m_hash(0xcbf29ce484222325ull)
+    , m_length(0)
+    , m_pending(0)
+{
+}
+
+void Checksum::update(const Byte* data, size_t size)
+{
+    m_length += size;
+    while (size > 0 && m_pending != 0) {
+        push(*data++);
+        --size;
+    }
+    for (; size >= 8; data += 8, size -= 8) {
+        mix(loadLittle(data, 8));
+    }
+    while (size > 0) {
+        push(*data++);
+        --size;
+    }
+}
+
+uint64_t Checksum::value() const
+{
+    uint64_t hash = m_hash;
+    if (m_pending != 0) {
+        hash = (hash ^ loadLittle(m_word, m_pending)) * prime;
+    }
+    return (hash ^ m_length) * prime;
+}
+
+void Checksum::mix(uint64_t word)
+{
+    m_hash = (m_hash ^ word) * prime;
+}
+
+void Checksum::push(Byte byte)
+{
+    m_word[m_pending++] = byte;
+    if (m_pending == 8) {
+        mix(loadLittle(m_word, 8));
+        m_pending = 0;
+    }
+}
+
+bool snapshot::syncFile(const std::string& path)
+{
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    const bool synced = ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    return synced;
+}
+
+bool snapshot::syncDirectory(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int descriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (descriptor < 0) {
+        return false;
+    }
+    const bool synced = ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    return synced;
+}
+
+bool snapshot::hasMagic(const Byte* data, size_t size)
+{
+    return size >= sizeof(magic) && std::memcmp(data, magic, sizeof(magic)) == 0;
+}
+
+void snapshot::write(ByteSink& sink, std::vector<Entry> temporary, std::vector<Entry> permanent)
+{
+    uint64_t namesSize = 0;
+    for (auto* table : {&temporary, &permanent}) {
+        std::sort(table->begin(), table->end(), [](const Entry& lhs, const Entry& rhs) {
+            return lhs.name < rhs.name;
+        });
+        for (const Entry& entry : *table) {
+            if (entry.name.size() > std::numeric_limits<uint32_t>::max()) {
+                throw std::length_error("User name too long for a snapshot.");
+            }
+            namesSize += entry.name.size();
+        }
+    }
+
+    // The checksum goes first, so the body is generated twice rather than held in memory.
+    Checksum checksum;
+    writeBody(temporary, permanent, [&checksum](const Byte* data, size_t size) {
+        checksum.update(data, size);
+    });
+
+    Byte header[headerSize] = {};
+    std::memcpy(header, magic, sizeof(magic));
+    storeLittle(header + 8, version, 4);
+    storeLittle(header + 12, valueSize, 4);
+    storeLittle(header + 16, temporary.size(), 8);
+    storeLittle(header + 24, permanent.size(), 8);
+    storeLittle(header + 32, namesSize, 8);
+    storeLittle(header + 40, checksum.value(), 8);
+    sink.write(header, headerSize);
+    writeBody(temporary, permanent, [&sink](const Byte* data, size_t size) {
+        sink.write(data, size);
+    });
+}
+
+View::View()
+    : m_records(nullptr)
+    , m_names(nullptr)
+    , m_temporaryCount(0)
+    , m_permanentCount(0)
+    , m_namesSize(0)
+{
+}
+
+bool View::open(const Byte* data, size_t size, bool verifyChecksum)
+{
+    if (size < headerSize || !hasMagic(data, size)) {
+        return false;
+    }
+    if (loadLittle(data + 8, 4) != version || loadLittle(data + 12, 4) != valueSize) {
+        return false;
+    }
+    const uint64_t temporaryCount = loadLittle(data + 16, 8);
+    const uint64_t permanentCount = loadLittle(data + 24, 8);
+    const uint64_t namesSize = loadLittle(data + 32, 8);
+    const uint64_t maxRecords = (size - headerSize) / recordSize;
+    if (temporaryCount > maxRecords || permanentCount > maxRecords - temporaryCount) {
+        return false;
+    }
+    const uint64_t recordsSize = (temporaryCount + permanentCount) * recordSize;
+    if (namesSize != size - headerSize - recordsSize) {
+        return false;
+    }
+    if (verifyChecksum) {
+        Checksum checksum;
+        checksum.update(data + headerSize, size - headerSize);
+        if (checksum.value() != loadLittle(data + 40, 8)) {
+            return false;
+        }
+        // The checksum is no proof against a crafted file, and the records are read anyway.
+        for (uint64_t i = 0; i < temporaryCount + permanentCount; ++i) {
+            if (!nameInBounds(data + headerSize + i * recordSize, namesSize)) {
+                return false;
+            }
+        }
+    }
+
+    m_records = data + headerSize;
+    m_names = m_records + recordsSize;
+    m_temporaryCount = temporaryCount;
+    m_permanentCount = permanentCount;
+    m_namesSize = namesSize;
+    return true;
+}
+
+size_t View::count(Table table) const
+{
+    return table == Table::Temporary ? m_temporaryCount : m_permanentCount;
+}
+
+std::string_view View::name(Table table, size_t index) const
+{
+    const Byte* entry = record(table, index);
+    if (!nameInBounds(entry, m_namesSize)) {
+        throw std::runtime_error("Corrupted snapshot record.");
+    }
+    return std::string_view(reinterpret_cast<const char*>(m_names + loadLittle(entry, 8)), loadLittle(entry + 8, 4));
+}
+
+Residue View::value(Table table, size_t index) const
+{
+    const Byte* encoded = encodedValue(table, index);
+    Residue result;
+    for (size_t i = 0; i < Residue::units; ++i) {
+        result[i] = loadLittle(encoded + 8 * i, 8);
+    }
+    return result;
+}
+
+const Byte* View::encodedValue(Table table, size_t index) const
+{
+    return record(table, index) + 16;
+}
+
+bool View::find(Table table, std::string_view name, Residue& value) const
+{
+    size_t index = 0;
+    if (!find(table, name, index)) {
+        return false;
+    }
+    value = this->value(table, index);
+    return true;
+}
+
+bool View::find(Table table, std::string_view name, size_t& index) const
+{
+    size_t first = 0;
+    size_t last = count(table);
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        if (this->name(table, middle) < name) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if (first == count(table) || this->name(table, first) != name) {
+        return false;
+    }
+    index = first;
+    return true;
+}
+
+const Byte* View::record(Table table, size_t index) const
+{
+    const uint64_t position = table == Table::Temporary ? index : m_temporaryCount + index;
+    return m_records + position * recordSize;
+}
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& path, bool verifyChecksum)
+{
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    void* address = MAP_FAILED;
+    if (::fstat(descriptor, &status) == 0 && status.st_size >= static_cast<off_t>(headerSize)) {
+        address = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    }
+    // The mapping keeps the file alive on its own.
+    ::close(descriptor);
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile(address, status.st_size));
+    if (!file->m_view.open(static_cast<const Byte*>(address), status.st_size, verifyChecksum)) {
+        return nullptr;
+    }
+    return file;
+}
+
+MappedFile::MappedFile(void* address, size_t size)
+    : m_address(address)
+    , m_size(size)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    ::munmap(m_address, m_size);
+}
+
+const View& MappedFile::view() const
+{
+    return m_view;
+}
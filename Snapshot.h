@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GroupParameters.h"
+#include "Utility.h"
+
+namespace E2EE {
+
+// Version 2 of the Engine snapshot format. All fields are little-endian and fixed width:
+//   header   "E2EESNAP", u32 version, u32 valueSize, u64 temporaryCount, u64 permanentCount,
+//            u64 namesSize, u64 checksum, 16 zero bytes
+//   records  the temporary table, then the permanent table, each sorted by name. A record is
+//            u64 nameOffset, u32 nameLength, u32 zero and valueSize bytes of value.
+//   names    namesSize bytes that the records point into
+// The checksum covers everything after the header. The tables are searched in place, so a
+// mapped file is usable without being parsed.
+namespace snapshot {
+
+using Residue = GroupParameters::Residue;
+
+const uint32_t version = 2;
+const size_t headerSize = 64;
+const size_t valueSize = Residue::units * 8;
+const size_t recordSize = 16 + valueSize;
+
+enum class Table
+{
+    Temporary,
+    Permanent
+};
+
+// A value to write, given either decoded or in its record encoding.
+struct Entry
+{
+    std::string_view name;
+    const Residue*   value = nullptr;
+    const Byte*      encoded = nullptr;
+};
+
+// Little-endian integers of the given number of bytes, at most 8.
+void storeLittle(Byte* out, uint64_t value, size_t bytes);
+uint64_t loadLittle(const Byte* in, size_t bytes);
+
+// FNV-1a over little-endian 64-bit words, the last one padded with zeros, and the length.
+class Checksum
+{
+public:
+    Checksum();
+
+    void update(const Byte* data, size_t size);
+    uint64_t value() const;
+
+private:
+    void mix(uint64_t word);
+    void push(Byte byte);
+
+private:
+    uint64_t m_hash;
+    uint64_t m_length;
+    Byte     m_word[8];
+    size_t   m_pending;
+};
+
+// Flushes the file at path to disk, returns false on failure.
+bool syncFile(const std::string& path);
+// Flushes the directory holding the file at path, which makes a rename or creation of the file
+// durable. Returns false on failure.
+bool syncDirectory(const std::string& path);
+
+// True if data starts like a version 2 snapshot, whether valid or not.
+bool hasMagic(const Byte* data, size_t size);
+
+// Writes the tables as a version 2 snapshot. Names must be unique within each table.
+void write(ByteSink& sink, std::vector<Entry> temporary, std::vector<Entry> permanent);
+
+// A version 2 snapshot in memory, read without copying.
+class View
+{
+public:
+    View();
+
+    // Checks the header and that the sizes add up to size, and if verifyChecksum the checksum
+    // and the bounds of every record name. The data must outlive the view.
+    bool open(const Byte* data, size_t size, bool verifyChecksum);
+
+    size_t count(Table table) const;
+    // The record names are bounds-checked on access, a corrupted one throws std::runtime_error.
+    // That only happens to views opened without verification.
+    std::string_view name(Table table, size_t index) const;
+    Residue value(Table table, size_t index) const;
+    const Byte* encodedValue(Table table, size_t index) const;
+    // Binary search by name, for the value or the index of the record.
+    bool find(Table table, std::string_view name, Residue& value) const;
+    bool find(Table table, std::string_view name, size_t& index) const;
+
+private:
+    const Byte* record(Table table, size_t index) const;
+
+private:
+    const Byte* m_records;
+    const Byte* m_names;
+    uint64_t    m_temporaryCount;
+    uint64_t    m_permanentCount;
+    uint64_t    m_namesSize;
+};
+
+// A snapshot file mapped read-only into memory. The file may be replaced or removed while it
+// is mapped.
+class MappedFile
+{
+public:
+    // Null if the file cannot be mapped or is not a valid version 2 snapshot.
+    static std::shared_ptr<const MappedFile> open(const std::string& path, bool verifyChecksum);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const View& view() const;
+
+private:
+    MappedFile(void* address, size_t size);
+
+private:
+    void*  m_address;
+    size_t m_size;
+    View   m_view;
+};
+
+} // namespace snapshot
+
+} // namespace E2EE
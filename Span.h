@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+namespace E2EE {
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+
+template <typename T>
+using Span = std::span<T>;
+
+#else
+
+// Non-owning view of a contiguous sequence, the subset of std::span that the Engine API needs,
+// for builds older than C++20.
+template <typename T>
+class Span
+{
+public:
+    constexpr Span()
+        : m_data(nullptr)
+        , m_size(0)
+    {}
+
+    constexpr Span(T* data, const size_t size)
+        : m_data(data)
+        , m_size(size)
+    {}
+
+    template <typename ContainerT>
+    constexpr Span(ContainerT& container)
+        : m_data(container.data())
+        , m_size(container.size())
+    {}
+
+    template <size_t N>
+    constexpr Span(T (&array)[N])
+        : m_data(array)
+        , m_size(N)
+    {}
+
+    constexpr T* data() const
+    {
+        return m_data;
+    }
+
+    constexpr size_t size() const
+    {
+        return m_size;
+    }
+
+    constexpr bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    constexpr T& operator[] (const size_t index) const
+    {
+        return m_data[index];
+    }
+
+    constexpr T* begin() const
+    {
+        return m_data;
+    }
+
+    constexpr T* end() const
+    {
+        return m_data + m_size;
+    }
+
+private:
+    T*     m_data;
+    size_t m_size;
+};
+
+#endif
+
+} // namespace E2EE
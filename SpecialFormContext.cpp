@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "SpecialFormContext.h"
+
+bool SpecialFormContext::supports(const BigInteger& modulus)
+{
+    const size_t n = modulus.unit_count();
+    if (modulus < 0 || n < 3 || n > max_units) {
+        return false;
+    }
+    unit_t units[max_units];
+    modulus.to_units(units, n);
+    const unit_t all_ones = ~unit_t(0);
+    return units[0] == all_ones && units[n - 1] == all_ones;
+}
+
+SpecialFormContext::SpecialFormContext(const BigInteger& modulus)
+    : m_modulus(modulus)
+{
+    if (!supports(modulus)) {
+        throw std::invalid_argument("Modulus must have all ones in its top and bottom limbs.");
+    }
+    const size_t n = modulus.unit_count();
+    m_units.resize(n);
+    modulus.to_units(m_units.data(), n);
+    precompute();
+}
+
+SpecialFormContext::SpecialFormContext(const unit_t* modulus, size_t n)
+    : m_modulus(BigInteger::from_units(modulus, n))
+    , m_units(modulus, modulus + n)
+{
+    if (!supports(m_modulus) || m_modulus.unit_count() != n) {
+        throw std::invalid_argument("Modulus must have all ones in its top and bottom limbs.");
+    }
+    precompute();
+}
+
+void SpecialFormContext::precompute()
+{
+    const size_t n = m_units.size();
+
+    // c = 2^(64 * n) - p is the two's complement of p. Its low limb is 1 and its top limb is 0,
+    // the limbs in between are stored as the fold constant c'.
+    m_fold.resize(n - 2);
+    for (size_t i = 0; i < n - 2; ++i) {
+        m_fold[i] = ~m_units[i + 1];
+    }
+
+    m_one.assign(n, 0);
+    m_one[0] = 1;
+}
+
+const BigInteger& SpecialFormContext::modulus() const
+{
+    return m_modulus;
+}
+
+size_t SpecialFormContext::size() const
+{
+    return m_units.size();
+}
+
+void SpecialFormContext::add(unit_t* result, const unit_t* lhs, const unit_t* rhs) const
+{
+    limbs::add_mod_n(result, lhs, rhs, m_units.data(), size());
+}
+
+void SpecialFormContext::multiply(unit_t* result, const unit_t* lhs, const unit_t* rhs) const
+{
+    const size_t n = size();
+    unit_t product[2 * max_units];
+    limbs::mul_n(product, lhs, rhs, n);
+    reduce(result, product);
+}
+
+void SpecialFormContext::square(unit_t* result, const unit_t* value) const
+{
+    unit_t product[2 * max_units];
+    limbs::sqr(product, value, size());
+    reduce(result, product);
+}
+
+void SpecialFormContext::reduce(unit_t* result, const unit_t* value) const
+{
+    const size_t n = size();
+    unit_t t[2 * max_units];
+    std::copy(value, value + 2 * n, t);
+
+    // q * 2^(64 * i) = q * 2^(64 * (i - n)) * (p + c), so clearing limb i means adding
+    // q * c = q + q * c' * 2^64 at limb i - n. q * c < 2^(64 * n), so limb i is left at
+    // most 1 and a second pass is rarely needed.
+    for (size_t i = 2 * n - 1; i >= n; --i) {
+        while (t[i] != 0) {
+            const unit_t q = t[i];
+            t[i] = 0;
+            unit_t carry = 0;
+            t[i - 1] = limbs::add_carry(t[i - 1], limbs::addmul_1(t + i - n + 1, m_fold.data(), n - 2, q), carry);
+            t[i] += carry;
+            carry = 0;
+            t[i - n] = limbs::add_carry(t[i - n], q, carry);
+            for (size_t j = i - n + 1; carry != 0; ++j) {
+                t[j] = limbs::add_carry(t[j], 0, carry);
+            }
+        }
+    }
+    if (limbs::cmp_n(t, m_units.data(), n) >= 0) {
+        limbs::sub_n(t, t, m_units.data(), n);
+    }
+    std::copy(t, t + n, result);
+}
+
+void SpecialFormContext::to_residue(unit_t* result, const BigInteger& value) const
+{
+    const size_t n = size();
+    if (value < 0 || value.unit_count() > 2 * n) {
+        BigInteger reduced = value % m_modulus;
+        if (reduced < 0) {
+            reduced += m_modulus;
+        }
+        reduced.to_units(result, n);
+        return;
+    }
+    unit_t units[2 * max_units];
+    value.to_units(units, 2 * n);
+    reduce(result, units);
+}
+
+BigInteger SpecialFormContext::from_residue(const unit_t* value) const
+{
+    return BigInteger::from_units(value, size());
+}
+
+void SpecialFormContext::to_residue(unit_t* result, const unit_t* value) const
+{
+    const size_t n = size();
+    unit_t units[2 * max_units] = {};
+    std::copy(value, value + n, units);
+    reduce(result, units);
+}
+
+void SpecialFormContext::from_residue(unit_t* result, const unit_t* value) const
+{
+    std::copy(value, value + size(), result);
+}
+
+const SpecialFormContext::unit_t* SpecialFormContext::one() const
+{
+    return m_one.data();
+}
+
+BigInteger SpecialFormContext::pow_mod(const BigInteger& base, const BigInteger& exponent) const
+{
+    return window_pow_mod(*this, base, exponent);
+}
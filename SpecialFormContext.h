@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "BigInteger.h"
+#include "Limbs.h"
+#include "ModularExponentiation.h"
+
+// Reduction modulo a prime p = 2^N - c of n limbs whose top and bottom limbs are all ones,
+// such as the RFC 3526 MODP group primes. The top limb being all ones makes the top limb of
+// the remainder a valid quotient digit, and the bottom limb being all ones makes c = 1 + 2^64 * c'
+// with c' only n - 2 limbs long, so every folding step is a single shift-and-add of q * c.
+// Residues are kept as n-limb arrays in ordinary form.
+class SpecialFormContext
+{
+public:
+    using unit_t = BigInteger::unit_t;
+
+    static const size_t max_units = 128;
+
+    // Returns true if modulus has the form this context requires.
+    static bool supports(const BigInteger& modulus);
+
+    explicit SpecialFormContext(const BigInteger& modulus);
+    SpecialFormContext(const unit_t* modulus, size_t n);
+
+    const BigInteger& modulus() const;
+    size_t size() const;
+
+    // result = lhs + rhs mod p. result may alias lhs or rhs.
+    void add(unit_t* result, const unit_t* lhs, const unit_t* rhs) const;
+    // result = lhs * rhs mod p. result may alias lhs or rhs.
+    void multiply(unit_t* result, const unit_t* lhs, const unit_t* rhs) const;
+    // result = value * value mod p. result may alias value.
+    void square(unit_t* result, const unit_t* value) const;
+    // result = value[0, 2n) mod p.
+    void reduce(unit_t* result, const unit_t* value) const;
+
+    void to_residue(unit_t* result, const BigInteger& value) const;
+    BigInteger from_residue(const unit_t* value) const;
+    // Conversions between n-limb ordinary values and residues. result may alias value.
+    void to_residue(unit_t* result, const unit_t* value) const;
+    void from_residue(unit_t* result, const unit_t* value) const;
+    const unit_t* one() const;
+
+    // Computes (base ^ exponent) % p with sliding-window square-and-multiply.
+    BigInteger pow_mod(const BigInteger& base, const BigInteger& exponent) const;
+    // Same on n-limb ordinary values, for any exponent type with bit_length() and test_bit().
+    template <typename ExponentT>
+    void pow_mod(unit_t* result, const unit_t* base, const ExponentT& exponent) const
+    {
+        to_residue(result, base);
+        window_pow_mod(*this, result, result, exponent);
+        from_residue(result, result);
+    }
+
+private:
+    void precompute();
+
+private:
+    BigInteger          m_modulus;
+    std::vector<unit_t> m_units;
+    std::vector<unit_t> m_fold;
+    std::vector<unit_t> m_one;
+};
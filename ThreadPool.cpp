@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <exception>
+
+#include "ThreadPool.h"
+
+using namespace E2EE;
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : m_pending(0)
+    , m_stopping(false)
+    , m_nextQueue(0)
+{
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return m_threads.size();
+}
+
+void ThreadPool::submit(Task task)
+{
+    if (m_queues.empty()) {
+        task();
+        return;
+    }
+    Queue& queue = *m_queues[m_nextQueue++ % m_queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_pending;
+    }
+    m_wakeUp.notify_one();
+}
+
+void ThreadPool::execute(Task task)
+{
+    submit(std::move(task));
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+    // Helpers that start after every index is taken return without touching body, so the
+    // state they share outlives this call safely.
+    struct State
+    {
+        const std::function<void(size_t)>* body;
+        size_t                             count;
+        std::atomic<size_t>                next;
+        size_t                             finished;
+        std::exception_ptr                 error;
+        std::mutex                         mutex;
+        std::condition_variable            done;
+    };
+    auto state = std::make_shared<State>();
+    state->body = &body;
+    state->count = count;
+    state->next = 0;
+    state->finished = 0;
+
+    auto work = [state] {
+        size_t index = 0;
+        while ((index = state->next++) < state->count) {
+            std::exception_ptr error;
+            try {
+                (*state->body)(index);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (++state->finished == state->count) {
+                state->done.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = std::min(size(), count > 0 ? count - 1 : 0);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&] { return state->finished == state->count; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+bool ThreadPool::take(size_t index, Task& task)
+{
+    // Own deque from the back, then the others from the front.
+    for (size_t i = 0; i < m_queues.size(); ++i) {
+        Queue& queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index)
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [this] { return m_stopping || m_pending != 0; });
+            if (m_pending == 0) {
+                return;
+            }
+            --m_pending;
+        }
+        // A task counted in m_pending is in some deque until it is taken, and each worker
+        // takes at most one task per count it consumed, so this finds one.
+        Task task;
+        while (!take(index, task)) {
+            std::this_thread::yield();
+        }
+        task();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Executor.h"
+
+namespace E2EE {
+
+// Fixed set of worker threads with one task deque each. Workers take their newest task first
+// and, when their own deque is empty, steal the oldest task of another worker.
+class ThreadPool : public Executor
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    void submit(Task task);
+    void execute(Task task) override;
+
+    // Calls body(i) for every i in [0, count) and returns once all calls have finished. The
+    // calling thread takes part, so this also makes progress from inside a task or with an empty
+    // pool. The first exception thrown by body is rethrown here.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    struct Queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool take(size_t index, Task& task);
+    void run(size_t index);
+
+private:
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread>            m_threads;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_wakeUp;
+    size_t                              m_pending;
+    bool                                m_stopping;
+    std::atomic<size_t>                 m_nextQueue;
+};
+
+} // namespace E2EE
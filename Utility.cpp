@@ -1,5 +1,14 @@
+#include <algorithm>
+#include <cstring>
+
 #include "Utility.h"
 
+namespace {
+
+const size_t bufferSize = 1 << 16;
+
+} // namespace
+
 ByteArray toByteArray(const BigInteger& value)
 {
     return toByteArray(value.raw_data());
@@ -7,8 +16,150 @@ ByteArray toByteArray(const BigInteger& value)
 
 int fromByteArray(const Byte* data, BigInteger& value)
 {
-    std::vector<BigInteger::unit_t> rawData;
-    auto bytesRead = fromByteArray(data, rawData);
+    // Decoded in place rather than through a temporary byte vector.
+    uint32_t size = 0;
+    const int bytesRead = fromByteArray(data, size);
+    value.set_raw_data(data + bytesRead, size);
+    return bytesRead + static_cast<int>(size);
+}
+
+ByteSink::ByteSink(std::ostream& stream)
+    : m_stream(&stream)
+    , m_array(nullptr)
+{
+    m_buffer.reserve(bufferSize);
+}
+
+ByteSink::ByteSink(ByteArray& array)
+    : m_stream(nullptr)
+    , m_array(&array)
+{
+}
+
+ByteSink::~ByteSink()
+{
+    flush();
+}
+
+void ByteSink::write(const Byte* data, size_t size)
+{
+    if (m_array != nullptr) {
+        m_array->append(data, size);
+        return;
+    }
+    if (m_buffer.size() + size > bufferSize) {
+        flush();
+    }
+    if (size > bufferSize) {
+        m_stream->write(reinterpret_cast<const char*>(data), size);
+        return;
+    }
+    m_buffer.insert(m_buffer.end(), data, data + size);
+}
+
+bool ByteSink::flush()
+{
+    if (m_stream == nullptr) {
+        return true;
+    }
+    if (!m_buffer.empty()) {
+        m_stream->write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size());
+        m_buffer.clear();
+    }
+    return m_stream->good();
+}
+
+ByteSource::ByteSource(std::istream& stream)
+    : m_stream(&stream)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_position(0)
+    , m_buffer(bufferSize)
+{
+}
+
+ByteSource::ByteSource(const Byte* data, size_t size)
+    : m_stream(nullptr)
+    , m_data(data)
+    , m_size(size)
+    , m_position(0)
+{
+}
+
+bool ByteSource::read(Byte* data, size_t size)
+{
+    while (size != 0) {
+        if (m_position == m_size && !refill()) {
+            return false;
+        }
+        const size_t chunk = std::min(size, m_size - m_position);
+        std::memcpy(data, m_data + m_position, chunk);
+        m_position += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool ByteSource::atEnd()
+{
+    return m_position == m_size && !refill();
+}
+
+bool ByteSource::refill()
+{
+    if (m_stream == nullptr) {
+        return false;
+    }
+    m_stream->read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size());
+    m_data = m_buffer.data();
+    m_size = static_cast<size_t>(m_stream->gcount());
+    m_position = 0;
+    return m_size != 0;
+}
+
+void writeTo(ByteSink& sink, const std::string& value)
+{
+    writeTo(sink, std::string_view(value));
+}
+
+void writeTo(ByteSink& sink, std::string_view value)
+{
+    writeTo(sink, static_cast<uint32_t>(value.size()));
+    sink.write(reinterpret_cast<const Byte*>(value.data()), value.size());
+}
+
+bool readFrom(ByteSource& source, std::string& value)
+{
+    uint32_t size = 0;
+    if (!readFrom(source, size)) {
+        return false;
+    }
+    // Grows with the data actually read, so a corrupted size cannot force a huge allocation.
+    value.clear();
+    char chunk[256];
+    while (size != 0) {
+        const uint32_t part = std::min<uint32_t>(size, sizeof(chunk));
+        if (!source.read(reinterpret_cast<Byte*>(chunk), part)) {
+            return false;
+        }
+        value.append(chunk, part);
+        size -= part;
+    }
+    return true;
+}
+
+void writeTo(ByteSink& sink, const BigInteger& value)
+{
+    writeTo(sink, value.raw_data());
+}
+
+bool readFrom(ByteSource& source, BigInteger& value)
+{
+    std::vector<BigInteger::byte_t> rawData;
+    if (!readFrom(source, rawData)) {
+        return false;
+    }
     value.set_raw_data(rawData);
-    return bytesRead;
+    return true;
 }
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
 #include <type_traits>
+#include <vector>
 
 #include "BigInteger.h"
+#include "FixedBigInt.h"
 
 template <typename ContainerT>
 struct has_begin
@@ -38,9 +45,85 @@ struct is_stl_container
     static const bool value = has_begin<ContainerT>::value && has_size<ContainerT>::value;
 };
 
+template <typename ContainerT>
+struct has_reserve
+{
+    using Yes = uint8_t;
+    using No = uint16_t;
+
+    template <typename T>
+    static Yes test( decltype( std::declval<T>().reserve(0) )* );
+    template <typename T>
+    static No test(...);
+
+    static const bool value = (sizeof(test<ContainerT>(nullptr)) == sizeof(Yes));
+};
+
 using Byte = uint8_t;
 using ByteArray = std::basic_string<Byte>;
 
+// Buffered destination for serialized data, either a stream or a ByteArray to append to.
+class ByteSink
+{
+public:
+    explicit ByteSink(std::ostream& stream);
+    explicit ByteSink(ByteArray& array);
+    ~ByteSink();
+
+    ByteSink(const ByteSink&) = delete;
+    ByteSink& operator=(const ByteSink&) = delete;
+
+    void write(const Byte* data, size_t size);
+    // Writes out the buffer, returns false if the stream has failed.
+    bool flush();
+
+private:
+    std::ostream*     m_stream;
+    ByteArray*        m_array;
+    std::vector<Byte> m_buffer;
+};
+
+// Buffered origin of serialized data, either a stream or a byte range.
+class ByteSource
+{
+public:
+    explicit ByteSource(std::istream& stream);
+    ByteSource(const Byte* data, size_t size);
+
+    ByteSource(const ByteSource&) = delete;
+    ByteSource& operator=(const ByteSource&) = delete;
+
+    // Returns false if fewer than size bytes are left.
+    bool read(Byte* data, size_t size);
+    // True once every byte has been read.
+    bool atEnd();
+
+private:
+    bool refill();
+
+private:
+    std::istream*     m_stream;
+    const Byte*       m_data;
+    size_t            m_size;
+    size_t            m_position;
+    std::vector<Byte> m_buffer;
+};
+
+// The largest element count that readFrom reserves up front, so that a corrupted count fails
+// on reading rather than on allocating.
+const uint32_t maxReserve = 1u << 24;
+
+template <typename ContainerT>
+void reserveFor(ContainerT& container, uint32_t size, typename std::enable_if<has_reserve<ContainerT>::value>::type* = nullptr)
+{
+    container.reserve(container.size() + std::min(size, maxReserve));
+}
+
+template <typename ContainerT>
+void reserveFor(ContainerT&, uint32_t, typename std::enable_if<!has_reserve<ContainerT>::value>::type* = nullptr)
+{
+}
+
 template <typename NumericT>
 ByteArray toByteArray(const NumericT value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* = nullptr);
 template <typename ContainerT>
@@ -48,6 +131,8 @@ ByteArray toByteArray(const ContainerT& container, typename std::enable_if<is_st
 template <typename U, typename V>
 ByteArray toByteArray(const std::pair<U, V>& p);
 ByteArray toByteArray(const BigInteger& value);
+template <size_t Bits>
+ByteArray toByteArray(const FixedBigInt<Bits>& value);
 
 template <typename NumericT>
 int fromByteArray(const Byte* data, NumericT& value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* = nullptr);
@@ -56,6 +141,33 @@ int fromByteArray(const Byte* data, ContainerT& container, typename std::enable_
 template <typename U, typename V>
 int fromByteArray(const Byte* data, std::pair<U, V>& p);
 int fromByteArray(const Byte* data, BigInteger& value);
+template <size_t Bits>
+int fromByteArray(const Byte* data, FixedBigInt<Bits>& value);
+
+// Streaming counterparts of toByteArray and fromByteArray with the same encoding. readFrom
+// returns false if the data ends early or does not fit the value.
+template <typename NumericT>
+void writeTo(ByteSink& sink, const NumericT value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* = nullptr);
+void writeTo(ByteSink& sink, const std::string& value);
+void writeTo(ByteSink& sink, std::string_view value);
+template <typename ContainerT>
+void writeTo(ByteSink& sink, const ContainerT& container, typename std::enable_if<is_stl_container<ContainerT>::value>::type* = nullptr);
+template <typename U, typename V>
+void writeTo(ByteSink& sink, const std::pair<U, V>& p);
+void writeTo(ByteSink& sink, const BigInteger& value);
+template <size_t Bits>
+void writeTo(ByteSink& sink, const FixedBigInt<Bits>& value);
+
+template <typename NumericT>
+bool readFrom(ByteSource& source, NumericT& value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* = nullptr);
+bool readFrom(ByteSource& source, std::string& value);
+template <typename ContainerT>
+bool readFrom(ByteSource& source, ContainerT& container, typename std::enable_if<is_stl_container<ContainerT>::value>::type* = nullptr);
+template <typename U, typename V>
+bool readFrom(ByteSource& source, std::pair<U, V>& p);
+bool readFrom(ByteSource& source, BigInteger& value);
+template <size_t Bits>
+bool readFrom(ByteSource& source, FixedBigInt<Bits>& value);
 
 template <typename NumericT>
 ByteArray toByteArray(const NumericT value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* /*= nullptr*/)
@@ -93,10 +205,11 @@ int fromByteArray(const Byte* data, ContainerT& container, typename std::enable_
     int bytesRead = 0;
     uint32_t containerSize = 0;
     bytesRead += fromByteArray(data, containerSize);
+    reserveFor(container, containerSize);
     for (uint32_t i = 0; i < containerSize; ++i) {
         typename ContainerT::value_type value;
         bytesRead += fromByteArray(data + bytesRead, value);
-        container.insert(container.end(), value);
+        container.insert(container.end(), std::move(value));
     }
     return bytesRead;
 }
@@ -120,3 +233,103 @@ int fromByteArray(const Byte* data, std::pair<U, V>& p)
     bytesRead += fromByteArray(data + bytesRead, second);
     return bytesRead;
 }
+
+// Fixed width integers use the same encoding as BigInteger.
+template <size_t Bits>
+ByteArray toByteArray(const FixedBigInt<Bits>& value)
+{
+    return toByteArray(value.to_big_integer());
+}
+
+template <size_t Bits>
+int fromByteArray(const Byte* data, FixedBigInt<Bits>& value)
+{
+    BigInteger bigValue;
+    int bytesRead = fromByteArray(data, bigValue);
+    value = FixedBigInt<Bits>(bigValue);
+    return bytesRead;
+}
+
+template <typename NumericT>
+void writeTo(ByteSink& sink, const NumericT value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* /*= nullptr*/)
+{
+    sink.write(reinterpret_cast<const Byte*>(&value), sizeof(NumericT));
+}
+
+template <typename NumericT>
+bool readFrom(ByteSource& source, NumericT& value, typename std::enable_if<std::is_arithmetic<NumericT>::value>::type* /*= nullptr*/)
+{
+    return source.read(reinterpret_cast<Byte*>(&value), sizeof(NumericT));
+}
+
+template <typename ContainerT>
+void writeTo(ByteSink& sink, const ContainerT& container, typename std::enable_if<is_stl_container<ContainerT>::value>::type* /*= nullptr*/)
+{
+    writeTo(sink, static_cast<uint32_t>(container.size()));
+    for (const auto& item : container) {
+        writeTo(sink, item);
+    }
+}
+
+template <typename ContainerT>
+bool readFrom(ByteSource& source, ContainerT& container, typename std::enable_if<is_stl_container<ContainerT>::value>::type* /*= nullptr*/)
+{
+    uint32_t containerSize = 0;
+    if (!readFrom(source, containerSize)) {
+        return false;
+    }
+    reserveFor(container, containerSize);
+    for (uint32_t i = 0; i < containerSize; ++i) {
+        typename ContainerT::value_type value;
+        if (!readFrom(source, value)) {
+            return false;
+        }
+        container.insert(container.end(), std::move(value));
+    }
+    return true;
+}
+
+template <typename U, typename V>
+void writeTo(ByteSink& sink, const std::pair<U, V>& p)
+{
+    writeTo(sink, p.first);
+    writeTo(sink, p.second);
+}
+
+template <typename U, typename V>
+bool readFrom(ByteSource& source, std::pair<U, V>& p)
+{
+    auto& first = const_cast<typename std::remove_const<U>::type&>(p.first);
+    auto& second = const_cast<typename std::remove_const<V>::type&>(p.second);
+    return readFrom(source, first) && readFrom(source, second);
+}
+
+// Written straight from the limbs, without going through BigInteger.
+template <size_t Bits>
+void writeTo(ByteSink& sink, const FixedBigInt<Bits>& value)
+{
+    const uint32_t byteCount = static_cast<uint32_t>((value.bit_length() + 7) / 8);
+    writeTo(sink, byteCount);
+    for (uint32_t i = 0; i < byteCount; ++i) {
+        const Byte byte = Byte(value[i / 8] >> (8 * (i % 8)));
+        sink.write(&byte, 1);
+    }
+}
+
+template <size_t Bits>
+bool readFrom(ByteSource& source, FixedBigInt<Bits>& value)
+{
+    uint32_t byteCount = 0;
+    if (!readFrom(source, byteCount) || byteCount > FixedBigInt<Bits>::units * 8) {
+        return false;
+    }
+    value = FixedBigInt<Bits>();
+    for (uint32_t i = 0; i < byteCount; ++i) {
+        Byte byte = 0;
+        if (!source.read(&byte, 1)) {
+            return false;
+        }
+        value[i / 8] |= typename FixedBigInt<Bits>::unit_t(byte) << (8 * (i % 8));
+    }
+    return value.bit_length() <= Bits;
+}